@@ -0,0 +1,288 @@
+// layout on synthetic trees with no window and no device: trees are built with the same view and
+// span builders as the app, laid out through LayoutTree, and every allocation made on the way is
+// counted by the operator new below
+//
+// usage: layout_bench [iterations]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+
+#include "instance.h"
+#include "layout_tree.h"
+
+namespace {
+    std::atomic<size_t> allocations = 0;
+    std::atomic<size_t> live = 0;
+    std::atomic<size_t> peak = 0;
+
+    // the block as malloc returned it and the size asked for sit right in front of the pointer
+    constexpr size_t header = 2 * sizeof(size_t);
+
+    void* allocate(size_t size, size_t align) {
+        align = std::max(align, header);
+
+        auto raw = static_cast<char*>(std::malloc(size + align + header));
+        if (!raw) throw std::bad_alloc();
+
+        auto p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(raw) + header + align - 1) & ~(align - 1));
+
+        reinterpret_cast<size_t*>(p)[-2] = static_cast<size_t>(p - raw);
+        reinterpret_cast<size_t*>(p)[-1] = size;
+
+        allocations.fetch_add(1, std::memory_order_relaxed);
+
+        auto now = live.fetch_add(size, std::memory_order_relaxed) + size;
+        auto high = peak.load(std::memory_order_relaxed);
+
+        while (now > high && !peak.compare_exchange_weak(high, now, std::memory_order_relaxed));
+
+        return p;
+    }
+
+    void release(void* ptr) {
+        if (!ptr) return;
+
+        auto p = static_cast<char*>(ptr);
+
+        live.fetch_sub(reinterpret_cast<size_t*>(p)[-1], std::memory_order_relaxed);
+        std::free(p - reinterpret_cast<size_t*>(p)[-2]);
+    }
+}
+
+void* operator new(size_t size) { return allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, std::align_val_t align) { return allocate(size, static_cast<size_t>(align)); }
+void operator delete(void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+
+namespace {
+    using namespace tau;
+    using Clock = std::chrono::steady_clock;
+
+    struct Scenario {
+        const char* name;
+        ptr<element>(*build)();
+    };
+
+    Quantity px(uint32_t v) {
+        return { .type = quantity_t::pixel, .value = static_cast<float>(v) };
+    }
+
+    // one long chain of blocks, every level padded
+    ptr<element> deepBlocks() {
+        auto node = view<>{ .layout = Block{ .dimensions = { .y = 10_px } } }();
+
+        for (int d = 0; d < 2000; ++d) {
+            elements children{ arenaResource() };
+            children.push_back(std::move(node));
+
+            node = view<>{ .layout = Block{ .padding = { .x = 1_px, .y = 1_px } } }(std::move(children));
+        }
+
+        return node;
+    }
+
+    // flex containers nested in alternating directions, each next to two growing siblings; every
+    // level measures the one below it, so this is where repeated measuring would show
+    ptr<element> deepFlex() {
+        ptr<element> node = view<>{ .layout = Block{ .dimensions = { .y = 10_px } } }();
+
+        for (int d = 0; d < 48; ++d) {
+            elements children{ arenaResource() };
+
+            node->item.grow = 1;
+            children.push_back(std::move(node));
+
+            for (int k = 0; k < 2; ++k) children.push_back(view<>{ .layout = Block{ .dimensions = { .x = 10_px, .y = 10_px } }, .item = { .grow = 1 } }());
+
+            node = view<>{ .layout = Flex{ .direction = d % 2 ? FlexDirection::row : FlexDirection::column, .gap = 2_px } }(std::move(children));
+        }
+
+        return node;
+    }
+
+    // a single block with a long list of rows
+    ptr<element> wideBlocks() {
+        elements children{ arenaResource() };
+
+        for (int i = 0; i < 100000; ++i) children.push_back(view<>{ .layout = Block{ .dimensions = { .y = px(16 + i % 8) }, .margin = { .y = 1_px } } }());
+
+        return view<>{ .layout = Block{} }(std::move(children));
+    }
+
+    // a wrapping flex row of cards
+    ptr<element> wideFlex() {
+        elements children{ arenaResource() };
+
+        for (int i = 0; i < 20000; ++i) children.push_back(view<>{ .layout = Block{ .dimensions = { .x = px(40 + i % 40), .y = 30_px } }, .item = { .grow = 1 } }());
+
+        return view<>{ .layout = Flex{ .wrap = true, .gap = 4_px } }(std::move(children));
+    }
+
+    // random blocks, flex rows and columns and text, the same every run
+    ptr<element> mixedNode(std::mt19937& rng, int depth, size_t& budget) {
+        if (budget == 0 || depth > 12 || rng() % 6 == 0) {
+            if (budget > 0) --budget;
+
+            if (rng() % 2) return span{}("some text");
+
+            return view<>{ .layout = Block{ .dimensions = { .y = px(8 + rng() % 32) } } }();
+        }
+
+        --budget;
+
+        elements children{ arenaResource() };
+
+        auto count = 1 + rng() % 8;
+        for (uint32_t i = 0; i < count && budget > 0; ++i) children.push_back(mixedNode(rng, depth + 1, budget));
+
+        switch (rng() % 3) {
+        case 0:
+            return view<>{ .layout = Block{ .padding = { .x = 2_px, .y = 2_px } } }(std::move(children));
+        case 1:
+            return view<>{ .layout = Flex{ .wrap = rng() % 2 == 0, .gap = 4_px } }(std::move(children));
+        default:
+            return view<>{ .layout = Flex{ .direction = FlexDirection::column, .align = Align::center } }(std::move(children));
+        }
+    }
+
+    ptr<element> mixed() {
+        std::mt19937 rng(42);
+        size_t budget = 50000;
+
+        elements children{ arenaResource() };
+
+        while (budget > 0) children.push_back(mixedNode(rng, 0, budget));
+
+        return view<>{ .layout = Block{} }(std::move(children));
+    }
+
+    size_t count(element& el) {
+        size_t n = 1;
+
+        for (auto& c : el.children) n += count(*c);
+
+        return n;
+    }
+
+    // the last node in pre-order, as deep as the tree gets on that side
+    element& lastLeaf(element& el) {
+        return el.children.empty() ? el : lastLeaf(*el.children.back());
+    }
+
+    double since(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Result {
+        double build = 0;
+        size_t buildAllocations = 0;
+        double layout = 1e30;
+        size_t layoutAllocations = 0;
+        double relayout = 1e30;
+        double resize = 1e30;
+        size_t peak = 0;
+    };
+
+    Result run(const Scenario& scenario, ThreadPool* pool, int iterations, size_t& nodes) {
+        Result r;
+
+        peak = live.load();
+        auto base = live.load();
+
+        auto arena = std::make_unique<Arena>();
+        ptr<element> root;
+
+        {
+            auto before = allocations.load();
+            auto start = Clock::now();
+
+            Arena::Scope scope(*arena);
+            root = scenario.build();
+
+            r.build = since(start);
+            r.buildAllocations = allocations.load() - before;
+        }
+
+        nodes = count(*root);
+
+        LayoutTree tree;
+        tree.pool = pool;
+
+        Box screen{ .left = 0, .top = 0, .width = 1920, .height = 1080 };
+
+        for (int i = 0; i < iterations; ++i) {
+            // a rebuild marks everything dirty, so this is a layout from scratch
+            tree.build(*root);
+
+            auto before = allocations.load();
+            auto start = Clock::now();
+
+            tree.layout(screen);
+
+            r.layout = std::min(r.layout, since(start));
+            r.layoutAllocations = allocations.load() - before;
+        }
+
+        auto& leaf = lastLeaf(*root);
+
+        for (int i = 0; i < iterations; ++i) {
+            leaf.setLayout(Block{ .dimensions = { .y = px(10 + i % 2) } });
+
+            auto start = Clock::now();
+            tree.layout(screen);
+            r.relayout = std::min(r.relayout, since(start));
+        }
+
+        for (int i = 0; i < iterations; ++i) {
+            screen.width = i % 2 ? 1920 : 1280;
+
+            auto start = Clock::now();
+            tree.layout(screen);
+            r.resize = std::min(r.resize, since(start));
+        }
+
+        r.peak = peak.load() - base;
+
+        root.reset();
+
+        return r;
+    }
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+
+    const Scenario scenarios[] = {
+        { "deep blocks", deepBlocks },
+        { "deep flex", deepFlex },
+        { "wide blocks", wideBlocks },
+        { "wide flex", wideFlex },
+        { "mixed", mixed }
+    };
+
+    ThreadPool pool;
+
+    std::printf("%-12s %-5s %8s %10s %8s %10s %10s %8s %12s %10s %9s\n", "scenario", "mode", "nodes", "build ms", "allocs", "layout ms", "Mnodes/s", "allocs", "relayout us", "resize ms", "peak MiB");
+
+    for (auto& s : scenarios) {
+        for (auto p : { static_cast<ThreadPool*>(nullptr), &pool }) {
+            size_t nodes = 0;
+            auto r = run(s, p, iterations, nodes);
+
+            std::printf("%-12s %-5s %8zu %10.2f %8zu %10.2f %10.2f %8zu %12.1f %10.2f %9.2f\n",
+                s.name, p ? "pool" : "seq", nodes,
+                r.build, r.buildAllocations,
+                r.layout, nodes / r.layout / 1000.0, r.layoutAllocations,
+                r.relayout * 1000.0, r.resize,
+                r.peak / (1024.0 * 1024.0));
+        }
+    }
+}
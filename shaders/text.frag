@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 uv;
+
+layout(binding = 0) uniform sampler2D page;
+
+void main() {
+    // the distance fields are rasterized with the outline at 128
+    float d = texture(page, uv).r;
+    float w = fwidth(d);
+    float alpha = smoothstep(0.5 - w, 0.5 + w, d);
+
+    // the padding around a glyph overlaps its neighbours, it mustn't write depth
+    if (alpha <= 0.0) discard;
+
+    outColor = vec4(1.0, 1.0, 1.0, alpha);
+}
@@ -0,0 +1,34 @@
+#version 450
+
+struct Vertex {
+    vec2 pos;
+    vec2 uv;
+};
+
+// one glyph: its quad the same way vert.vert places a box, and its rectangle on the glyph page
+layout(push_constant) uniform Glyph {
+    vec2 pos;
+    vec2 scale;
+    vec2 uvOffset;
+    vec2 uvScale;
+} glyph;
+
+Vertex vertices[4] = {
+    {{-1.0, -1.0}, {0.0, 0.0}},
+    {{-1.0, 1.0}, {0.0, 1.0}},
+    {{1.0, -1.0}, {1.0, 0.0}},
+    {{1.0, 1.0}, {1.0, 1.0}}
+};
+
+int indices[6] = int[](
+    0, 1, 2,
+    1, 3, 2
+);
+
+layout(location = 0) out vec2 uv;
+
+void main() {
+    Vertex vertex = vertices[indices[gl_VertexIndex]];
+    gl_Position = vec4(vertex.pos * glyph.scale + glyph.pos, 0.0, 1.0);
+    uv = glyph.uvOffset + vertex.uv * glyph.uvScale;
+}
@@ -0,0 +1,227 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+static vk::DeviceSize alignUp(vk::DeviceSize v, vk::DeviceSize alignment) {
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+tau::Allocation::Allocation(Allocation&& other) noexcept {
+    *this = std::move(other);
+}
+
+tau::Allocation& tau::Allocation::operator=(Allocation&& other) noexcept {
+    if (this == &other) return *this;
+
+    reset();
+
+    memory = std::exchange(other.memory, nullptr);
+    offset = std::exchange(other.offset, 0);
+    size = std::exchange(other.size, 0);
+    mapped = std::exchange(other.mapped, nullptr);
+    allocator = std::exchange(other.allocator, nullptr);
+    block = std::exchange(other.block, nullptr);
+
+    return *this;
+}
+
+tau::Allocation::~Allocation() {
+    reset();
+}
+
+void tau::Allocation::reset() {
+    if (allocator) allocator->release(*this);
+
+    memory = nullptr;
+    offset = 0;
+    size = 0;
+    mapped = nullptr;
+    allocator = nullptr;
+    block = nullptr;
+}
+
+std::optional<vk::DeviceSize> tau::MemoryBlock::take(vk::DeviceSize bytes, vk::DeviceSize alignment) {
+    for (size_t i = 0; i < free.size(); ++i) {
+        auto range = free[i];
+        auto begin = alignUp(range.offset, alignment);
+        auto end = begin + bytes;
+
+        if (end > range.offset + range.size) continue;
+
+        // whatever alignment skipped stays on the free list as its own range
+        auto tail = Range{ .offset = end, .size = range.offset + range.size - end };
+
+        if (begin > range.offset) {
+            free[i].size = begin - range.offset;
+
+            if (tail.size > 0) free.insert(free.begin() + i + 1, tail);
+        } else if (tail.size > 0) {
+            free[i] = tail;
+        } else {
+            free.erase(free.begin() + i);
+        }
+
+        ++allocations;
+
+        return begin;
+    }
+
+    return std::nullopt;
+}
+
+void tau::MemoryBlock::give(vk::DeviceSize offset, vk::DeviceSize bytes) {
+    auto it = std::lower_bound(free.begin(), free.end(), offset, [](const Range& r, vk::DeviceSize o) { return r.offset < o; });
+
+    it = free.insert(it, Range{ .offset = offset, .size = bytes });
+
+    auto next = it + 1;
+    if (next != free.end() && it->offset + it->size == next->offset) {
+        it->size += next->size;
+        free.erase(next);
+    }
+
+    if (it != free.begin()) {
+        auto prev = it - 1;
+
+        if (prev->offset + prev->size == it->offset) {
+            prev->size += it->size;
+            free.erase(it);
+        }
+    }
+
+    --allocations;
+}
+
+void tau::Allocator::init(const vk::raii::Device& dev, const vk::raii::PhysicalDevice& physicalDevice) {
+    device = &dev;
+    memoryProperties = physicalDevice.getMemoryProperties();
+}
+
+size_t tau::Allocator::heapIndex(MemoryPool pool, bool linear, uint32_t memoryType) {
+    return ((static_cast<size_t>(pool) * 2) + (linear ? 1 : 0)) * VK_MAX_MEMORY_TYPES + memoryType;
+}
+
+tau::MemoryPool tau::Allocator::heapPool(size_t heap) {
+    return static_cast<MemoryPool>(heap / (2 * VK_MAX_MEMORY_TYPES));
+}
+
+uint32_t tau::Allocator::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+tau::MemoryBlock& tau::Allocator::createBlock(size_t heap, uint32_t memoryType, vk::DeviceSize size) {
+    vk::MemoryAllocateInfo allocInfo{};
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    auto block = std::make_unique<MemoryBlock>();
+    block->memory = device->allocateMemory(allocInfo);
+    block->size = size;
+    block->heap = heap;
+    block->free.push_back({ .offset = 0, .size = size });
+
+    // host visible blocks stay mapped for their whole lifetime, a memory object can only be mapped once
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        block->mapped = block->memory.mapMemory(0, size);
+    }
+
+    heaps[heap].push_back(std::move(block));
+
+    return *heaps[heap].back();
+}
+
+tau::Allocation tau::Allocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, MemoryPool pool, bool linear) {
+    auto memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+    auto heap = heapIndex(pool, linear, memoryType);
+
+    std::optional<vk::DeviceSize> offset;
+    MemoryBlock* block = nullptr;
+
+    for (auto& b : heaps[heap]) {
+        offset = b->take(requirements.size, requirements.alignment);
+
+        if (offset.has_value()) {
+            block = b.get();
+            break;
+        }
+    }
+
+    if (!block) {
+        auto blockSize = pool == MemoryPool::staging ? staging_block_size : persistent_block_size;
+
+        // anything that wouldn't leave room for a second resource gets a block of its own
+        if (requirements.size > blockSize / 2) blockSize = alignUp(requirements.size, requirements.alignment);
+
+        block = &createBlock(heap, memoryType, blockSize);
+        offset = block->take(requirements.size, requirements.alignment);
+    }
+
+    Allocation a;
+    a.memory = *block->memory;
+    a.offset = offset.value();
+    a.size = requirements.size;
+    a.mapped = block->mapped ? static_cast<char*>(block->mapped) + a.offset : nullptr;
+    a.allocator = this;
+    a.block = block;
+
+    used[static_cast<size_t>(pool)] += a.size;
+    ++allocations[static_cast<size_t>(pool)];
+
+    return a;
+}
+
+void tau::Allocator::release(Allocation& allocation) {
+    auto block = allocation.block;
+    auto pool = static_cast<size_t>(heapPool(block->heap));
+
+    block->give(allocation.offset, allocation.size);
+
+    used[pool] -= allocation.size;
+    --allocations[pool];
+
+    if (block->allocations > 0) return;
+
+    // keep a single empty block around per heap so a load/unload cycle doesn't hit the driver every time
+    auto& heap = heaps[block->heap];
+
+    auto empty = std::count_if(heap.begin(), heap.end(), [](const auto& b) { return b->allocations == 0; });
+    auto dedicated = block->size != (heapPool(block->heap) == MemoryPool::staging ? staging_block_size : persistent_block_size);
+
+    if (empty > 1 || dedicated) {
+        std::erase_if(heap, [block](const auto& b) { return b.get() == block; });
+    }
+}
+
+tau::Allocator::Stats tau::Allocator::stats(MemoryPool pool) const {
+    Stats s;
+
+    for (size_t i = 0; i < heaps.size(); ++i) {
+        if (heapPool(i) != pool) continue;
+
+        for (auto& b : heaps[i]) {
+            ++s.blocks;
+            s.reserved += b->size;
+        }
+    }
+
+    s.allocations = allocations[static_cast<size_t>(pool)];
+    s.used = used[static_cast<size_t>(pool)];
+
+    return s;
+}
+
+size_t tau::Allocator::deviceAllocations() const {
+    size_t n = 0;
+
+    for (auto& heap : heaps) n += heap.size();
+
+    return n;
+}
@@ -0,0 +1,105 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace tau {
+    class Allocator;
+    struct MemoryBlock;
+
+    // long-lived resources (textures, uniform buffers, depth) and short-lived upload memory
+    // are carved out of different blocks so staging churn never fragments the persistent heaps
+    enum class MemoryPool {
+        persistent,
+        staging
+    };
+
+    struct Allocation {
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        void* mapped = nullptr;
+
+        Allocation() = default;
+        Allocation(Allocation&& other) noexcept;
+        Allocation& operator=(Allocation&& other) noexcept;
+        ~Allocation();
+
+        void reset();
+
+    private:
+        friend class Allocator;
+
+        Allocator* allocator = nullptr;
+        MemoryBlock* block = nullptr;
+    };
+
+    struct MemoryBlock {
+        struct Range {
+            vk::DeviceSize offset;
+            vk::DeviceSize size;
+        };
+
+        vk::raii::DeviceMemory memory = nullptr;
+        vk::DeviceSize size = 0;
+        void* mapped = nullptr;
+        size_t heap = 0;
+        size_t allocations = 0;
+
+        // sorted by offset, neighbours are always coalesced
+        std::vector<Range> free;
+
+        std::optional<vk::DeviceSize> take(vk::DeviceSize size, vk::DeviceSize alignment);
+        void give(vk::DeviceSize offset, vk::DeviceSize size);
+    };
+
+    class Allocator {
+    public:
+        static constexpr vk::DeviceSize persistent_block_size = 64ull * 1024 * 1024;
+        static constexpr vk::DeviceSize staging_block_size = 16ull * 1024 * 1024;
+
+        struct Stats {
+            size_t blocks = 0;
+            size_t allocations = 0;
+            vk::DeviceSize reserved = 0;
+            vk::DeviceSize used = 0;
+        };
+
+        void init(const vk::raii::Device& device, const vk::raii::PhysicalDevice& physicalDevice);
+
+        // linear resources (buffers) and optimal-tiling images never share a block, which keeps
+        // bufferImageGranularity out of the picture entirely
+        Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, MemoryPool pool, bool linear);
+
+        Stats stats(MemoryPool pool) const;
+
+        // number of live VkDeviceMemory objects, to compare against maxMemoryAllocationCount
+        size_t deviceAllocations() const;
+
+    private:
+        friend struct Allocation;
+
+        using Heap = std::vector<std::unique_ptr<MemoryBlock>>;
+
+        const vk::raii::Device* device = nullptr;
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
+
+        std::array<Heap, 2 * 2 * VK_MAX_MEMORY_TYPES> heaps;
+        std::array<vk::DeviceSize, 2> used{};
+        std::array<size_t, 2> allocations{};
+
+        static size_t heapIndex(MemoryPool pool, bool linear, uint32_t memoryType);
+        static MemoryPool heapPool(size_t heap);
+
+        uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const;
+        MemoryBlock& createBlock(size_t heap, uint32_t memoryType, vk::DeviceSize size);
+        void release(Allocation& allocation);
+    };
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+namespace tau {
+    // one generation of the element tree: nodes, layouts and child arrays built while it is current
+    // are carved out of the same growing buffer, and all of it is given back at once when the
+    // generation is dropped; only destructors run per node
+    class Arena {
+    public:
+        static constexpr size_t initial_size = 64 * 1024;
+
+        inline static thread_local Arena* current = nullptr;
+
+        explicit Arena(size_t initialSize = initial_size) : buffer(initialSize) {}
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        std::pmr::memory_resource* resource() { return &buffer; }
+
+        // everything made in this scope comes from `arena`
+        class Scope {
+        public:
+            explicit Scope(Arena& arena) : previous(std::exchange(current, &arena)) {}
+            ~Scope() { current = previous; }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            Arena* previous;
+        };
+
+    private:
+        std::pmr::monotonic_buffer_resource buffer;
+    };
+
+    // where child arrays go: the current arena, or the heap outside of any generation
+    inline std::pmr::memory_resource* arenaResource() {
+        return Arena::current ? Arena::current->resource() : std::pmr::new_delete_resource();
+    }
+
+    // arena objects are only destroyed, their memory goes back with the arena
+    struct ArenaDeleter {
+        bool heap = true;
+
+        template<typename T>
+        void operator()(T* p) const {
+            if (heap) delete p;
+            else p->~T();
+        }
+    };
+
+    template<typename T>
+    using ptr = std::unique_ptr<T, ArenaDeleter>;
+
+    template<typename T, typename... Args>
+    ptr<T> make(Args&&... args) {
+        if (auto arena = Arena::current) {
+            void* memory = arena->resource()->allocate(sizeof(T), alignof(T));
+
+            return ptr<T>(new (memory) T(std::forward<Args>(args)...), ArenaDeleter{ .heap = false });
+        }
+
+        return ptr<T>(new T(std::forward<Args>(args)...), ArenaDeleter{ .heap = true });
+    }
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include "atlas.h"
+#include "instance.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <cstring>
+
+std::optional<tau::AtlasSlot> tau::ShelfPacker::pack(uint32_t w, uint32_t h) {
+    if (w > width || h > height) return std::nullopt;
+
+    // the tightest shelf that still has room, so a short icon doesn't eat a tall row
+    Shelf* best = nullptr;
+
+    for (auto& shelf : shelves) {
+        if (shelf.height < h || shelf.x + w > width) continue;
+        if (best && best->height <= shelf.height) continue;
+
+        best = &shelf;
+    }
+
+    // wasting more than half a row is worse than starting a new one, as long as there is space left
+    if (best && best->height > h * 2 && bottom + h <= height) best = nullptr;
+
+    if (!best) {
+        if (bottom + h > height) return std::nullopt;
+
+        shelves.push_back({ .y = bottom, .height = h, .x = 0 });
+        bottom += h;
+
+        best = &shelves.back();
+    }
+
+    AtlasSlot slot{ .x = best->x, .y = best->y };
+    best->x += w;
+
+    return slot;
+}
+
+bool tau::Instance::packIntoAtlas(CombinedImage& entry, const DecodedImage& decoded) {
+    auto w = decoded.width;
+    auto h = decoded.height;
+
+    if (decoded.format != vk::Format::eR8G8B8A8Unorm || w > atlas_max_size || h > atlas_max_size) return false;
+
+    // a one texel border copied from the edge, so filtering at the rim never reaches a neighbour
+    uint32_t pw = w + 2;
+    uint32_t ph = h + 2;
+
+    AtlasPage* page = nullptr;
+    std::optional<AtlasSlot> slot;
+
+    for (auto& p : atlasPages) {
+        slot = p.packer.pack(pw, ph);
+
+        if (slot) {
+            page = &p;
+            break;
+        }
+    }
+
+    bool fresh = !page;
+
+    if (fresh) {
+        auto& p = atlasPages.emplace_back();
+        p.image = createImage(atlas_page_size, atlas_page_size, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+        p.packer = ShelfPacker(atlas_page_size, atlas_page_size);
+
+        page = &p;
+        slot = page->packer.pack(pw, ph);
+    }
+
+    auto src = static_cast<const unsigned char*>(decoded.staged ? decoded.staged->mapped : decoded.pixels.get());
+
+    auto range = stage(vk::DeviceSize(pw) * ph * 4);
+    auto dst = static_cast<unsigned char*>(range.mapped);
+
+    for (uint32_t y = 0; y < ph; ++y) {
+        auto row = src + size_t(std::clamp<int64_t>(int64_t(y) - 1, 0, h - 1)) * w * 4;
+        auto out = dst + size_t(y) * pw * 4;
+
+        std::memcpy(out, row, 4);
+        std::memcpy(out + 4, row, size_t(w) * 4);
+        std::memcpy(out + size_t(w + 1) * 4, row + size_t(w - 1) * 4, 4);
+    }
+
+    // the padded copy is all the upload needs
+    if (decoded.staged) staging.commit(*decoded.staged, 0);
+
+    auto& batch = uploads();
+
+    if (fresh) batch.clearPage(*page->image.image);
+
+    batch.patch(range, *page->image.image, slot->x, slot->y, pw, ph);
+
+    float size = atlas_page_size;
+
+    entry.page = page;
+    entry.uvOffset = { (slot->x + 1) / size, (slot->y + 1) / size };
+    entry.uvScale = { w / size, h / size };
+    entry.img = Image{};
+    entry.img.upload = batch.serial;
+
+    return true;
+}
+
+tau::FontChar& tau::Font::glyph(uint32_t codepoint) {
+    {
+        std::shared_lock lock(mutex);
+
+        if (auto it = indices.find(codepoint); it != indices.end()) return glyphs.find(it->second)->second;
+    }
+
+    std::unique_lock lock(mutex);
+
+    // someone else may have added it in between
+    if (auto it = indices.find(codepoint); it != indices.end()) return glyphs.find(it->second)->second;
+
+    int index = stbtt_FindGlyphIndex(&info, static_cast<int>(codepoint));
+    indices.emplace(codepoint, index);
+
+    auto[it, fresh] = glyphs.try_emplace(index);
+
+    if (fresh) {
+        int advance;
+        stbtt_GetGlyphHMetrics(&info, index, &advance, nullptr);
+
+        it->second.index = index;
+        it->second.advance = advance * scale;
+    }
+
+    return it->second;
+}
+
+const tau::FontChar& tau::Instance::glyph(Font& font, uint32_t codepoint) {
+    auto& fc = font.glyph(codepoint);
+
+    if (fc.ready) return fc;
+
+    fc.ready = true;
+
+    int x, y, w, h;
+    auto data = stbtt_GetGlyphSDF(&font.info, font.scale, fc.index, 3, 128, 64.0f, &w, &h, &x, &y);
+
+    if (!data) return fc;
+
+    fc.x = x;
+    fc.y = y;
+    fc.w = w;
+    fc.h = h;
+
+    // a texel of space to the right and below, so filtering never reaches a neighbour
+    AtlasPage* page = nullptr;
+    std::optional<AtlasSlot> slot;
+
+    for (auto& p : glyphPages) {
+        slot = p.packer.pack(w + 1, h + 1);
+
+        if (slot) {
+            page = &p;
+            break;
+        }
+    }
+
+    if (!page && glyphPages.size() < glyph_max_pages) {
+        auto& p = glyphPages.emplace_back();
+        p.image = createImage(glyph_page_size, glyph_page_size, vk::Format::eR8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+        p.packer = ShelfPacker(glyph_page_size, glyph_page_size);
+
+        uploads().clearPage(*p.image.image);
+
+        page = &p;
+        slot = page->packer.pack(w + 1, h + 1);
+    }
+
+    if (slot) {
+        pendingGlyphs.push_back({
+            .glyph = &fc,
+            .page = page,
+            .slot = *slot,
+            .width = static_cast<uint32_t>(w),
+            .height = static_cast<uint32_t>(h),
+            .pixels = std::vector<uint8_t>(data, data + size_t(w) * h)
+        });
+
+        float size = glyph_page_size;
+
+        fc.page = page;
+        fc.uvOffset = { slot->x / size, slot->y / size };
+        fc.uvScale = { w / size, h / size };
+    }
+
+    stbtt_FreeSDF(data, nullptr);
+
+    return fc;
+}
+
+void tau::Instance::flushGlyphs() {
+    if (pendingGlyphs.empty()) return;
+
+    // every glyph of the frame in one staging range, each starting on a multiple of 4
+    vk::DeviceSize total = 0;
+    for (auto& g : pendingGlyphs) total += (g.pixels.size() + 3) & ~vk::DeviceSize(3);
+
+    auto range = stage(total);
+    auto dst = static_cast<unsigned char*>(range.mapped);
+
+    std::vector<vk::DeviceSize> offsets;
+    offsets.reserve(pendingGlyphs.size());
+
+    vk::DeviceSize offset = 0;
+
+    for (auto& g : pendingGlyphs) {
+        std::memcpy(dst + offset, g.pixels.data(), g.pixels.size());
+
+        offsets.push_back(range.offset + offset);
+        offset += (g.pixels.size() + 3) & ~vk::DeviceSize(3);
+    }
+
+    auto& batch = uploads();
+
+    for (auto& g : pendingGlyphs) g.glyph->upload = batch.serial;
+
+    // one copy per page, whatever number of glyphs landed on it
+    std::vector<vk::BufferImageCopy> regions;
+
+    for (auto& page : glyphPages) {
+        regions.clear();
+
+        for (size_t i = 0; i < pendingGlyphs.size(); ++i) {
+            auto& g = pendingGlyphs[i];
+
+            if (g.page != &page) continue;
+
+            vk::BufferImageCopy region{};
+            region.bufferOffset = offsets[i];
+            region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = vk::Offset3D{ int32_t(g.slot.x), int32_t(g.slot.y), 0 };
+            region.imageExtent = vk::Extent3D{ g.width, g.height, 1 };
+
+            regions.push_back(region);
+        }
+
+        if (!regions.empty()) batch.patch(range.buffer, *page.image.image, regions);
+    }
+
+    pendingGlyphs.clear();
+}
+
+void tau::Instance::drawText(vk::raii::CommandBuffer& cmd, Font& font, std::string_view text, float x, float y) {
+    if (!*textPipeline.pipeline) createTextPipeline();
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *textPipeline.pipeline);
+
+    float width = static_cast<float>(swapchain.extent.width);
+    float height = static_cast<float>(swapchain.extent.height);
+
+    float pen = x;
+    float baseline = y + font.ascent;
+
+    AtlasPage* bound = nullptr;
+
+    for (size_t i = 0; i < text.size();) {
+        auto& fc = glyph(font, nextCodepoint(text, i));
+
+        // blanks only move the pen, and a glyph made this frame shows up once its copy is acquired
+        if (fc.page && fc.upload <= uploadsAcquired) {
+            if (fc.page != bound) {
+                bound = fc.page;
+
+                if (!*bound->set) {
+                    vk::DescriptorSetLayout layout = *glyphSetLayout;
+
+                    vk::DescriptorSetAllocateInfo allocInfo{};
+                    allocInfo.descriptorPool = *glyphPool;
+                    allocInfo.descriptorSetCount = 1;
+                    allocInfo.pSetLayouts = &layout;
+
+                    bound->set = std::move(device.allocateDescriptorSets(allocInfo)[0]);
+
+                    // distance fields are filtered, never mipmapped
+                    vk::DescriptorImageInfo info{};
+                    info.sampler = getSampler({ .mipmap = vk::SamplerMipmapMode::eNearest, .maxLod = 0.0f });
+                    info.imageView = *bound->image.view;
+                    info.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+                    vk::WriteDescriptorSet wds{};
+                    wds.dstSet = *bound->set;
+                    wds.dstBinding = 0;
+                    wds.dstArrayElement = 0;
+                    wds.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+                    wds.descriptorCount = 1;
+                    wds.pImageInfo = &info;
+
+                    device.updateDescriptorSets({ wds }, nullptr);
+                }
+
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *textPipeline.layout, 0, { *bound->set }, nullptr);
+            }
+
+            // the field's top left is relative to the pen on the baseline
+            float w = fc.w / width;
+            float h = fc.h / height;
+
+            GlyphConstants c;
+            c.position = { -1.0f + 2.0f * (pen + fc.x) / width + w, -1.0f + 2.0f * (baseline + fc.y) / height + h };
+            c.scale = { w, h };
+            c.uvOffset = fc.uvOffset;
+            c.uvScale = fc.uvScale;
+
+            cmd.pushConstants<GlyphConstants>(*textPipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, { c });
+
+            cmd.draw(6, 1, 0, 0);
+        }
+
+        pen += fc.advance;
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace tau {
+    struct AtlasSlot {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    // rows of rectangles filled left to right, a new row opens below the last one whenever nothing
+    // fits; rectangles are never given back, a full page is simply retired with everything on it
+    class ShelfPacker {
+    public:
+        ShelfPacker() = default;
+        ShelfPacker(uint32_t width, uint32_t height) : width(width), height(height) {}
+
+        std::optional<AtlasSlot> pack(uint32_t w, uint32_t h);
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+    private:
+        struct Shelf {
+            uint32_t y;
+            uint32_t height;
+            uint32_t x;
+        };
+
+        std::vector<Shelf> shelves;
+        uint32_t bottom = 0;
+    };
+}
+
+#endif
@@ -27,6 +27,16 @@ namespace tau {
         vec2 scale;
         ivec2 dimensions;
     };
+
+    // shaders/text.vert, it shares createPipeline's push constant range with BoxConstants
+    struct alignas(16) GlyphConstants {
+        vec2 position;
+        vec2 scale;
+        vec2 uvOffset;
+        vec2 uvScale;
+    };
+
+    static_assert(sizeof(GlyphConstants) <= sizeof(BoxConstants));
 }
     
 #endif
@@ -0,0 +1,470 @@
+#include "compressed.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+    template<typename T>
+    T read(std::span<const unsigned char> bytes, size_t offset) {
+        T v;
+        std::memcpy(&v, bytes.data() + offset, sizeof(T));
+        return v;
+    }
+
+    // sRGB variants are sampled like their UNORM twins, the same way every png is
+    vk::Format fromVkFormat(uint32_t format) {
+        switch (format) {
+            case 131: case 132: return vk::Format::eBc1RgbUnormBlock;
+            case 133: case 134: return vk::Format::eBc1RgbaUnormBlock;
+            case 137: case 138: return vk::Format::eBc3UnormBlock;
+            case 145: case 146: return vk::Format::eBc7UnormBlock;
+            default: return vk::Format::eUndefined;
+        }
+    }
+
+    vk::Format fromDxgiFormat(uint32_t format) {
+        switch (format) {
+            case 71: case 72: return vk::Format::eBc1RgbaUnormBlock;
+            case 77: case 78: return vk::Format::eBc3UnormBlock;
+            case 98: case 99: return vk::Format::eBc7UnormBlock;
+            default: return vk::Format::eUndefined;
+        }
+    }
+
+    // a full chain down to 1x1, anything past it would shift the size out of range
+    uint32_t maxLevels(uint32_t width, uint32_t height) {
+        return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+    }
+
+    constexpr uint32_t fourCC(const char (&s)[5]) {
+        return uint32_t(s[0]) | (uint32_t(s[1]) << 8) | (uint32_t(s[2]) << 16) | (uint32_t(s[3]) << 24);
+    }
+
+    std::optional<tau::CompressedImage> parseKtx2(std::span<const unsigned char> file) {
+        // identifier, 9 header words, the index and at least one level entry
+        constexpr size_t header = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+
+        if (file.size() < header + 24) return std::nullopt;
+
+        auto format = fromVkFormat(read<uint32_t>(file, 12));
+        auto width = read<uint32_t>(file, 20);
+        auto height = read<uint32_t>(file, 24);
+        auto depth = read<uint32_t>(file, 28);
+        auto layers = read<uint32_t>(file, 32);
+        auto faces = read<uint32_t>(file, 36);
+        auto levels = std::max(read<uint32_t>(file, 40), 1u);
+        auto supercompression = read<uint32_t>(file, 44);
+
+        if (format == vk::Format::eUndefined || width == 0 || height == 0) return std::nullopt;
+        if (depth > 1 || layers > 1 || faces != 1 || supercompression != 0) return std::nullopt;
+        if (levels > maxLevels(width, height)) return std::nullopt;
+        if (file.size() < header + size_t(levels) * 24) return std::nullopt;
+
+        tau::CompressedImage image;
+        image.format = format;
+
+        for (uint32_t i = 0; i < levels; ++i) {
+            auto offset = read<uint64_t>(file, header + size_t(i) * 24);
+            auto length = read<uint64_t>(file, header + size_t(i) * 24 + 8);
+
+            uint32_t w = std::max(width >> i, 1u);
+            uint32_t h = std::max(height >> i, 1u);
+
+            // written so neither side can wrap
+            if (offset > file.size() || length > file.size() - offset || length < tau::compressedSize(format, w, h)) return std::nullopt;
+
+            image.levels.push_back({ file.subspan(offset, tau::compressedSize(format, w, h)), w, h });
+        }
+
+        return image;
+    }
+
+    std::optional<tau::CompressedImage> parseDds(std::span<const unsigned char> file) {
+        // magic and DDS_HEADER
+        constexpr size_t header = 4 + 124;
+
+        if (file.size() < header) return std::nullopt;
+
+        auto height = read<uint32_t>(file, 12);
+        auto width = read<uint32_t>(file, 16);
+        auto levels = std::max(read<uint32_t>(file, 28), 1u);
+        auto pixelFlags = read<uint32_t>(file, 80);
+        auto code = read<uint32_t>(file, 84);
+
+        // DDPF_FOURCC
+        if (!(pixelFlags & 0x4)) return std::nullopt;
+
+        size_t offset = header;
+        vk::Format format = vk::Format::eUndefined;
+
+        if (code == fourCC("DXT1")) format = vk::Format::eBc1RgbaUnormBlock;
+        else if (code == fourCC("DXT5")) format = vk::Format::eBc3UnormBlock;
+        else if (code == fourCC("DX10")) {
+            if (file.size() < header + 20) return std::nullopt;
+
+            format = fromDxgiFormat(read<uint32_t>(file, header));
+
+            // only plain 2d textures, no arrays
+            if (read<uint32_t>(file, header + 4) != 3 || read<uint32_t>(file, header + 12) > 1) return std::nullopt;
+
+            offset += 20;
+        }
+
+        if (format == vk::Format::eUndefined || width == 0 || height == 0) return std::nullopt;
+
+        // writers leave all sorts of things in mipMapCount, more levels than the chain has are dropped
+        levels = std::min(levels, maxLevels(width, height));
+
+        tau::CompressedImage image;
+        image.format = format;
+
+        for (uint32_t i = 0; i < levels; ++i) {
+            uint32_t w = std::max(width >> i, 1u);
+            uint32_t h = std::max(height >> i, 1u);
+            auto length = tau::compressedSize(format, w, h);
+
+            if (offset > file.size() || length > file.size() - offset) return std::nullopt;
+
+            image.levels.push_back({ file.subspan(offset, length), w, h });
+            offset += length;
+        }
+
+        return image;
+    }
+
+    struct Rgba {
+        unsigned char c[4];
+    };
+
+    void store(const Rgba (&texels)[16], uint32_t bx, uint32_t by, uint32_t width, uint32_t height, unsigned char* rgba) {
+        for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y) {
+            for (uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                std::memcpy(rgba + ((size_t(by) * 4 + y) * width + bx * 4 + x) * 4, texels[y * 4 + x].c, 4);
+            }
+        }
+    }
+
+    Rgba expand565(uint16_t c) {
+        unsigned char r = (c >> 11) & 0x1f;
+        unsigned char g = (c >> 5) & 0x3f;
+        unsigned char b = c & 0x1f;
+
+        return { { static_cast<unsigned char>((r << 3) | (r >> 2)), static_cast<unsigned char>((g << 2) | (g >> 4)), static_cast<unsigned char>((b << 3) | (b >> 2)), 255 } };
+    }
+
+    // the colour half of BC1 and BC3; BC3 always uses four colours whatever the endpoint order
+    void decodeColor(const unsigned char* block, Rgba (&texels)[16], bool fourAlways, bool opaque) {
+        auto c0 = uint16_t(block[0] | (block[1] << 8));
+        auto c1 = uint16_t(block[2] | (block[3] << 8));
+
+        Rgba palette[4] = { expand565(c0), expand565(c1) };
+
+        if (c0 > c1 || fourAlways) {
+            for (int k = 0; k < 3; ++k) {
+                palette[2].c[k] = static_cast<unsigned char>((2 * palette[0].c[k] + palette[1].c[k] + 1) / 3);
+                palette[3].c[k] = static_cast<unsigned char>((palette[0].c[k] + 2 * palette[1].c[k] + 1) / 3);
+            }
+
+            palette[2].c[3] = 255;
+            palette[3].c[3] = 255;
+        } else {
+            for (int k = 0; k < 3; ++k) palette[2].c[k] = static_cast<unsigned char>((palette[0].c[k] + palette[1].c[k]) / 2);
+
+            palette[2].c[3] = 255;
+            palette[3] = { { 0, 0, 0, static_cast<unsigned char>(opaque ? 255 : 0) } };
+        }
+
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (uint32_t(block[7]) << 24);
+
+        for (int i = 0; i < 16; ++i) texels[i] = palette[(indices >> (i * 2)) & 0x3];
+    }
+
+    void decodeAlpha(const unsigned char* block, Rgba (&texels)[16]) {
+        unsigned a0 = block[0];
+        unsigned a1 = block[1];
+
+        unsigned char palette[8] = { static_cast<unsigned char>(a0), static_cast<unsigned char>(a1) };
+
+        if (a0 > a1) {
+            for (unsigned i = 1; i < 7; ++i) palette[i + 1] = static_cast<unsigned char>(((7 - i) * a0 + i * a1 + 3) / 7);
+        } else {
+            for (unsigned i = 1; i < 5; ++i) palette[i + 1] = static_cast<unsigned char>(((5 - i) * a0 + i * a1 + 2) / 5);
+
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; ++i) indices |= uint64_t(block[2 + i]) << (i * 8);
+
+        for (int i = 0; i < 16; ++i) texels[i].c[3] = palette[(indices >> (i * 3)) & 0x7];
+    }
+
+    // BC7, straight from the format description: partition shapes, then anchor texels per shape
+    constexpr unsigned char partitions2[64][16] = {
+        {0,0,1,1,0,0,1,1,0,0,1,1,0,0,1,1}, {0,0,0,1,0,0,0,1,0,0,0,1,0,0,0,1}, {0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1}, {0,0,0,1,0,0,1,1,0,0,1,1,0,1,1,1},
+        {0,0,0,0,0,0,0,1,0,0,0,1,0,0,1,1}, {0,0,1,1,0,1,1,1,0,1,1,1,1,1,1,1}, {0,0,0,1,0,0,1,1,0,1,1,1,1,1,1,1}, {0,0,0,0,0,0,0,1,0,0,1,1,0,1,1,1},
+        {0,0,0,0,0,0,0,0,0,0,0,1,0,0,1,1}, {0,0,1,1,0,1,1,1,1,1,1,1,1,1,1,1}, {0,0,0,0,0,0,0,1,0,1,1,1,1,1,1,1}, {0,0,0,0,0,0,0,0,0,0,0,1,0,1,1,1},
+        {0,0,0,1,0,1,1,1,1,1,1,1,1,1,1,1}, {0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1}, {0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1}, {0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1},
+        {0,0,0,0,1,0,0,0,1,1,1,0,1,1,1,1}, {0,1,1,1,0,0,0,1,0,0,0,0,0,0,0,0}, {0,0,0,0,0,0,0,0,1,0,0,0,1,1,1,0}, {0,1,1,1,0,0,1,1,0,0,0,1,0,0,0,0},
+        {0,0,1,1,0,0,0,1,0,0,0,0,0,0,0,0}, {0,0,0,0,1,0,0,0,1,1,0,0,1,1,1,0}, {0,0,0,0,0,0,0,0,1,0,0,0,1,1,0,0}, {0,1,1,1,0,0,1,1,0,0,1,1,0,0,0,1},
+        {0,0,1,1,0,0,0,1,0,0,0,1,0,0,0,0}, {0,0,0,0,1,0,0,0,1,0,0,0,1,1,0,0}, {0,1,1,0,0,1,1,0,0,1,1,0,0,1,1,0}, {0,0,1,1,0,1,1,0,0,1,1,0,1,1,0,0},
+        {0,0,0,1,0,1,1,1,1,1,1,0,1,0,0,0}, {0,0,0,0,1,1,1,1,1,1,1,1,0,0,0,0}, {0,1,1,1,0,0,0,1,1,0,0,0,1,1,1,0}, {0,0,1,1,1,0,0,1,1,0,0,1,1,1,0,0},
+        {0,1,0,1,0,1,0,1,0,1,0,1,0,1,0,1}, {0,0,0,0,1,1,1,1,0,0,0,0,1,1,1,1}, {0,1,0,1,1,0,1,0,0,1,0,1,1,0,1,0}, {0,0,1,1,0,0,1,1,1,1,0,0,1,1,0,0},
+        {0,0,1,1,1,1,0,0,0,0,1,1,1,1,0,0}, {0,1,0,1,0,1,0,1,1,0,1,0,1,0,1,0}, {0,1,1,0,1,0,0,1,0,1,1,0,1,0,0,1}, {0,1,0,1,1,0,1,0,1,0,1,0,0,1,0,1},
+        {0,1,1,1,0,0,1,1,1,1,0,0,1,1,1,0}, {0,0,0,1,0,0,1,1,1,1,0,0,1,0,0,0}, {0,0,1,1,0,0,1,0,0,1,0,0,1,1,0,0}, {0,0,1,1,1,0,1,1,1,1,0,1,1,1,0,0},
+        {0,1,1,0,1,0,0,1,1,0,0,1,0,1,1,0}, {0,0,1,1,1,1,0,0,1,1,0,0,0,0,1,1}, {0,1,1,0,0,1,1,0,1,0,0,1,1,0,0,1}, {0,0,0,0,0,1,1,0,0,1,1,0,0,0,0,0},
+        {0,1,0,0,1,1,1,0,0,1,0,0,0,0,0,0}, {0,0,1,0,0,1,1,1,0,0,1,0,0,0,0,0}, {0,0,0,0,0,0,1,0,0,1,1,1,0,0,1,0}, {0,0,0,0,0,1,0,0,1,1,1,0,0,1,0,0},
+        {0,1,1,0,1,1,0,0,1,0,0,1,0,0,1,1}, {0,0,1,1,0,1,1,0,1,1,0,0,1,0,0,1}, {0,1,1,0,0,0,1,1,1,0,0,1,1,1,0,0}, {0,0,1,1,1,0,0,1,1,1,0,0,0,1,1,0},
+        {0,1,1,0,1,1,0,0,1,1,0,0,1,0,0,1}, {0,1,1,0,0,0,1,1,0,0,1,1,1,0,0,1}, {0,1,1,1,1,1,1,0,1,0,0,0,0,0,0,1}, {0,0,0,1,1,0,0,0,1,1,1,0,0,1,1,1},
+        {0,0,0,0,1,1,1,1,0,0,1,1,0,0,1,1}, {0,0,1,1,0,0,1,1,1,1,1,1,0,0,0,0}, {0,0,1,0,0,0,1,0,1,1,1,0,1,1,1,0}, {0,1,0,0,0,1,0,0,0,1,1,1,0,1,1,1}
+    };
+
+    constexpr unsigned char partitions3[64][16] = {
+        {0,0,1,1,0,0,1,1,0,2,2,1,2,2,2,2}, {0,0,0,1,0,0,1,1,2,2,1,1,2,2,2,1}, {0,0,0,0,2,0,0,1,2,2,1,1,2,2,1,1}, {0,2,2,2,0,0,2,2,0,0,1,1,0,1,1,1},
+        {0,0,0,0,0,0,0,0,1,1,2,2,1,1,2,2}, {0,0,1,1,0,0,1,1,0,0,2,2,0,0,2,2}, {0,0,2,2,0,0,2,2,1,1,1,1,1,1,1,1}, {0,0,1,1,0,0,1,1,2,2,1,1,2,2,1,1},
+        {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2}, {0,0,0,0,1,1,1,1,1,1,1,1,2,2,2,2}, {0,0,0,0,1,1,1,1,2,2,2,2,2,2,2,2}, {0,0,1,2,0,0,1,2,0,0,1,2,0,0,1,2},
+        {0,1,1,2,0,1,1,2,0,1,1,2,0,1,1,2}, {0,1,2,2,0,1,2,2,0,1,2,2,0,1,2,2}, {0,0,1,1,0,1,1,2,1,1,2,2,1,2,2,2}, {0,0,1,1,2,0,0,1,2,2,0,0,2,2,2,0},
+        {0,0,0,1,0,0,1,1,0,1,1,2,1,1,2,2}, {0,1,1,1,0,0,1,1,2,0,0,1,2,2,0,0}, {0,0,0,0,1,1,2,2,1,1,2,2,1,1,2,2}, {0,0,2,2,0,0,2,2,0,0,2,2,1,1,1,1},
+        {0,1,1,1,0,1,1,1,0,2,2,2,0,2,2,2}, {0,0,0,1,0,0,0,1,2,2,2,1,2,2,2,1}, {0,0,0,0,0,0,1,1,0,1,2,2,0,1,2,2}, {0,0,0,0,1,1,0,0,2,2,1,0,2,2,1,0},
+        {0,1,2,2,0,1,2,2,0,0,1,1,0,0,0,0}, {0,0,1,2,0,0,1,2,1,1,2,2,2,2,2,2}, {0,1,1,0,1,2,2,1,1,2,2,1,0,1,1,0}, {0,0,0,0,0,1,1,0,1,2,2,1,1,2,2,1},
+        {0,0,2,2,1,1,0,2,1,1,0,2,0,0,2,2}, {0,1,1,0,0,1,1,0,2,0,0,2,2,2,2,2}, {0,0,1,1,0,1,2,2,0,1,2,2,0,0,1,1}, {0,0,0,0,2,0,0,0,2,2,1,1,2,2,2,1},
+        {0,0,0,0,0,0,0,2,1,1,2,2,1,2,2,2}, {0,2,2,2,0,0,2,2,0,0,1,2,0,0,1,1}, {0,0,1,1,0,0,1,2,0,0,2,2,0,2,2,2}, {0,1,2,0,0,1,2,0,0,1,2,0,0,1,2,0},
+        {0,0,0,0,1,1,1,1,2,2,2,2,0,0,0,0}, {0,1,2,0,1,2,0,1,2,0,1,2,0,1,2,0}, {0,1,2,0,2,0,1,2,1,2,0,1,0,1,2,0}, {0,0,1,1,2,2,0,0,1,1,2,2,0,0,1,1},
+        {0,0,1,1,1,1,2,2,2,2,0,0,0,0,1,1}, {0,1,0,1,0,1,0,1,2,2,2,2,2,2,2,2}, {0,0,0,0,0,0,0,0,2,1,2,1,2,1,2,1}, {0,0,2,2,1,1,2,2,0,0,2,2,1,1,2,2},
+        {0,0,2,2,0,0,1,1,0,0,2,2,0,0,1,1}, {0,2,2,0,1,2,2,1,0,2,2,0,1,2,2,1}, {0,1,0,1,2,2,2,2,2,2,2,2,0,1,0,1}, {0,0,0,0,2,1,2,1,2,1,2,1,2,1,2,1},
+        {0,1,0,1,0,1,0,1,0,1,0,1,2,2,2,2}, {0,2,2,2,0,1,1,1,0,2,2,2,0,1,1,1}, {0,0,0,2,1,1,1,2,0,0,0,2,1,1,1,2}, {0,0,0,0,2,1,1,2,2,1,1,2,2,1,1,2},
+        {0,2,2,2,0,1,1,1,0,1,1,1,0,2,2,2}, {0,0,0,2,1,1,1,2,1,1,1,2,0,0,0,2}, {0,1,1,0,0,1,1,0,0,1,1,0,2,2,2,2}, {0,0,0,0,0,0,0,0,2,1,1,2,2,1,1,2},
+        {0,1,1,0,0,1,1,0,2,2,2,2,2,2,2,2}, {0,0,2,2,0,0,1,1,0,0,1,1,0,0,2,2}, {0,0,2,2,1,1,2,2,1,1,2,2,0,0,2,2}, {0,0,0,0,0,0,0,0,0,0,0,0,2,1,1,2},
+        {0,0,0,2,0,0,0,1,0,0,0,2,0,0,0,1}, {0,2,2,2,1,2,2,2,0,2,2,2,1,2,2,2}, {0,1,0,1,2,2,2,2,2,2,2,2,2,2,2,2}, {0,1,1,1,2,0,1,1,2,2,0,1,2,2,2,0}
+    };
+
+    constexpr unsigned char anchors2[64] = {
+        15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15, 15, 2, 8, 2, 2, 8, 8,15, 2, 8, 2, 2, 8, 8, 2, 2,
+        15,15, 6, 8, 2, 8,15,15, 2, 8, 2, 2, 2,15,15, 6, 6, 2, 6, 8,15,15, 2, 2, 15,15,15,15,15, 2, 2,15
+    };
+
+    constexpr unsigned char anchors3a[64] = {
+         3, 3,15,15, 8, 3,15,15, 8, 8, 6, 6, 6, 5, 3, 3, 3, 3, 8,15, 3, 3, 6,10, 5, 8, 8, 6, 8, 5,15,15,
+         8,15, 3, 5, 6,10, 8,15,15, 3,15, 5,15,15,15,15, 3,15, 5, 5, 5, 8, 5,10, 5,10, 8,13,15,12, 3, 3
+    };
+
+    constexpr unsigned char anchors3b[64] = {
+        15, 8, 8, 3,15,15, 3, 8,15,15,15,15,15,15,15, 8,15, 8,15, 3,15, 8,15, 8, 3,15, 6,10,15,15,10, 8,
+        15, 3,15,10,10, 8, 9,10, 6,15, 8,15, 3, 6, 6, 8,15, 3,15,15,15,15,15,15,15,15,15,15, 3,15,15, 8
+    };
+
+    constexpr unsigned char weights2[4] = { 0, 21, 43, 64 };
+    constexpr unsigned char weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    constexpr unsigned char weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    struct Bc7Mode {
+        int subsets;
+        int partitionBits;
+        int rotationBits;
+        int selectorBits;
+        int colorBits;
+        int alphaBits;
+        int endpointPBits;
+        int sharedPBits;
+        int indexBits;
+        int secondIndexBits;
+    };
+
+    constexpr Bc7Mode bc7Modes[8] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+    };
+
+    struct Bits {
+        const unsigned char* block;
+        int at = 0;
+
+        unsigned take(int n) {
+            unsigned v = 0;
+
+            for (int i = 0; i < n; ++i, ++at) v |= ((block[at >> 3] >> (at & 7)) & 1u) << i;
+
+            return v;
+        }
+    };
+
+    unsigned char interpolate(unsigned e0, unsigned e1, int bits, unsigned index) {
+        auto w = bits == 2 ? weights2[index] : bits == 3 ? weights3[index] : weights4[index];
+
+        return static_cast<unsigned char>(((64 - w) * e0 + w * e1 + 32) >> 6);
+    }
+
+    void decodeBc7(const unsigned char* block, Rgba (&texels)[16]) {
+        int mode = 0;
+        while (mode < 8 && !(block[0] & (1 << mode))) ++mode;
+
+        // reserved encoding
+        if (mode == 8) {
+            for (auto& t : texels) t = { { 0, 0, 0, 0 } };
+            return;
+        }
+
+        auto& m = bc7Modes[mode];
+        Bits bits{ block, mode + 1 };
+
+        unsigned partition = bits.take(m.partitionBits);
+        unsigned rotation = bits.take(m.rotationBits);
+        unsigned selector = bits.take(m.selectorBits);
+
+        // [subset][endpoint][channel]
+        unsigned endpoints[3][2][4] = {};
+
+        for (int c = 0; c < 3; ++c) {
+            for (int s = 0; s < m.subsets; ++s) {
+                for (int e = 0; e < 2; ++e) endpoints[s][e][c] = bits.take(m.colorBits);
+            }
+        }
+
+        for (int s = 0; s < m.subsets; ++s) {
+            for (int e = 0; e < 2; ++e) endpoints[s][e][3] = m.alphaBits ? bits.take(m.alphaBits) : 255;
+        }
+
+        int colorBits = m.colorBits;
+        int alphaBits = m.alphaBits;
+
+        if (m.endpointPBits || m.sharedPBits) {
+            unsigned p[3][2];
+
+            for (int s = 0; s < m.subsets; ++s) {
+                if (m.sharedPBits) p[s][0] = p[s][1] = bits.take(1);
+                else {
+                    p[s][0] = bits.take(1);
+                    p[s][1] = bits.take(1);
+                }
+            }
+
+            for (int s = 0; s < m.subsets; ++s) {
+                for (int e = 0; e < 2; ++e) {
+                    for (int c = 0; c < (alphaBits ? 4 : 3); ++c) endpoints[s][e][c] = (endpoints[s][e][c] << 1) | p[s][e];
+                }
+            }
+
+            ++colorBits;
+            if (alphaBits) ++alphaBits;
+        }
+
+        for (int s = 0; s < m.subsets; ++s) {
+            for (int e = 0; e < 2; ++e) {
+                for (int c = 0; c < 4; ++c) {
+                    int n = c < 3 ? colorBits : alphaBits;
+                    if (n == 0) continue;
+
+                    auto v = endpoints[s][e][c] << (8 - n);
+                    endpoints[s][e][c] = v | (v >> n);
+                }
+            }
+        }
+
+        auto subsetOf = [&](int i) -> int {
+            if (m.subsets == 2) return partitions2[partition][i];
+            if (m.subsets == 3) return partitions3[partition][i];
+            return 0;
+        };
+
+        auto isAnchor = [&](int i) {
+            if (i == 0) return true;
+            if (m.subsets == 2) return i == anchors2[partition];
+            if (m.subsets == 3) return i == anchors3a[partition] || i == anchors3b[partition];
+            return false;
+        };
+
+        unsigned indices[16];
+        unsigned secondIndices[16] = {};
+
+        for (int i = 0; i < 16; ++i) indices[i] = bits.take(isAnchor(i) ? m.indexBits - 1 : m.indexBits);
+
+        if (m.secondIndexBits) {
+            for (int i = 0; i < 16; ++i) secondIndices[i] = bits.take(i == 0 ? m.secondIndexBits - 1 : m.secondIndexBits);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            auto& ep = endpoints[subsetOf(i)];
+            auto& t = texels[i];
+
+            if (m.secondIndexBits) {
+                // the selector bit swaps which index set drives colour and which drives alpha
+                int cb = selector ? m.secondIndexBits : m.indexBits;
+                int ab = selector ? m.indexBits : m.secondIndexBits;
+                unsigned ci = selector ? secondIndices[i] : indices[i];
+                unsigned ai = selector ? indices[i] : secondIndices[i];
+
+                for (int c = 0; c < 3; ++c) t.c[c] = interpolate(ep[0][c], ep[1][c], cb, ci);
+                t.c[3] = interpolate(ep[0][3], ep[1][3], ab, ai);
+            } else {
+                for (int c = 0; c < 4; ++c) t.c[c] = interpolate(ep[0][c], ep[1][c], m.indexBits, indices[i]);
+            }
+
+            if (rotation) std::swap(t.c[3], t.c[rotation - 1]);
+        }
+    }
+}
+
+std::optional<tau::CompressedImage> tau::parseCompressed(std::span<const unsigned char> file) {
+    static constexpr unsigned char ktx2[12] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+    if (file.size() >= sizeof(ktx2) && std::memcmp(file.data(), ktx2, sizeof(ktx2)) == 0) return parseKtx2(file);
+    if (file.size() >= 4 && std::memcmp(file.data(), "DDS ", 4) == 0) return parseDds(file);
+
+    return std::nullopt;
+}
+
+size_t tau::blockBytes(vk::Format format) {
+    switch (format) {
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbaUnormBlock:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+size_t tau::compressedSize(vk::Format format, uint32_t width, uint32_t height) {
+    return ((size_t(width) + 3) / 4) * ((size_t(height) + 3) / 4) * blockBytes(format);
+}
+
+void tau::decompress(vk::Format format, const unsigned char* blocks, uint32_t width, uint32_t height, unsigned char* rgba) {
+    auto stride = blockBytes(format);
+    auto bw = static_cast<uint32_t>((size_t(width) + 3) / 4);
+    auto bh = static_cast<uint32_t>((size_t(height) + 3) / 4);
+
+    Rgba texels[16];
+
+    for (uint32_t by = 0; by < bh; ++by) {
+        for (uint32_t bx = 0; bx < bw; ++bx) {
+            auto block = blocks + (size_t(by) * bw + bx) * stride;
+
+            switch (format) {
+                case vk::Format::eBc1RgbUnormBlock:
+                    decodeColor(block, texels, false, true);
+                    break;
+                case vk::Format::eBc1RgbaUnormBlock:
+                    decodeColor(block, texels, false, false);
+                    break;
+                case vk::Format::eBc3UnormBlock:
+                    decodeColor(block + 8, texels, true, false);
+                    decodeAlpha(block, texels);
+                    break;
+                case vk::Format::eBc7UnormBlock:
+                    decodeBc7(block, texels);
+                    break;
+                default:
+                    return;
+            }
+
+            store(texels, bx, by, width, height, rgba);
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef COMPRESSED_H
+#define COMPRESSED_H
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace tau {
+    // a block compressed texture as it sits in a .ktx2 or .dds file, levels point into the file
+    struct CompressedImage {
+        struct Level {
+            std::span<const unsigned char> data;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        vk::Format format = vk::Format::eUndefined;
+        std::vector<Level> levels;
+    };
+
+    // BC1, BC3 and BC7 only, without supercompression; anything else comes back empty
+    std::optional<CompressedImage> parseCompressed(std::span<const unsigned char> file);
+
+    size_t blockBytes(vk::Format format);
+    size_t compressedSize(vk::Format format, uint32_t width, uint32_t height);
+
+    // for devices that can't sample `format`, writes width * height RGBA8 texels
+    void decompress(vk::Format format, const unsigned char* blocks, uint32_t width, uint32_t height, unsigned char* rgba);
+}
+
+#endif
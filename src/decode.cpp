@@ -0,0 +1,333 @@
+#include "decode.h"
+#include "compressed.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <stb_image.h>
+
+namespace {
+    // stb_image always allocates its own output; while a sink is armed the first allocation of
+    // exactly the output size (jpeg asks for one spare byte) is served from mapped staging memory
+    // instead, so the decoder's final pass writes every texel straight into the upload buffer
+    struct Sink {
+        void* data = nullptr;
+        size_t size = 0;
+        bool armed = false;
+        bool taken = false;
+    };
+
+    thread_local Sink sink;
+}
+
+void* tau::detail::stbi_malloc(size_t size) {
+    if (sink.armed && (size == sink.size || size == sink.size + 1)) {
+        sink.armed = false;
+        sink.taken = true;
+
+        return sink.data;
+    }
+
+    return std::malloc(size);
+}
+
+void* tau::detail::stbi_realloc(void* p, size_t size) {
+    // something other than the output grabbed the sink, move it back onto the heap
+    if (p && sink.taken && p == sink.data) {
+        sink.taken = false;
+
+        void* q = std::malloc(size);
+        if (q) std::memcpy(q, p, std::min(size, sink.size));
+
+        return q;
+    }
+
+    return std::realloc(p, size);
+}
+
+void tau::detail::stbi_free(void* p) {
+    if (p && sink.taken && p == sink.data) {
+        sink.taken = false;
+        return;
+    }
+
+    std::free(p);
+}
+
+namespace {
+    bool endsWith(const std::string& s, std::string_view suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // room for `size` bytes, in the ring if it can spare them and on the heap otherwise
+    unsigned char* output(tau::DecodedImage& decoded, tau::StagingRing& staging, size_t size) {
+        if (size <= staging.capacity / 4) decoded.staged = staging.reserve(size);
+
+        if (decoded.staged) return static_cast<unsigned char*>(decoded.staged->mapped);
+
+        auto heap = static_cast<unsigned char*>(std::malloc(size));
+        if (heap) decoded.pixels = { heap, [](void* p) { std::free(p); } };
+
+        return heap;
+    }
+
+    void decodeCompressed(tau::DecodedImage& decoded, const tau::CompressedImage& image, tau::StagingRing& staging, uint32_t width, uint32_t height, std::span<const vk::Format> compressed) {
+        auto& top = image.levels.front();
+        auto[w, h] = tau::fitResolution(top.width, top.height, width, height);
+
+        // the shipped mip chain does the downscaling, start at the first level that fits
+        size_t base = 0;
+        while (base + 1 < image.levels.size() && (image.levels[base].width > w || image.levels[base].height > h)) ++base;
+
+        auto& level = image.levels[base];
+
+        if (std::find(compressed.begin(), compressed.end(), image.format) != compressed.end()) {
+            size_t size = 0;
+
+            for (size_t i = base; i < image.levels.size(); ++i) {
+                decoded.levels.push_back({ size, image.levels[i].width, image.levels[i].height });
+                size += image.levels[i].data.size();
+            }
+
+            auto out = output(decoded, staging, size);
+            if (!out) return;
+
+            for (size_t i = base; i < image.levels.size(); ++i) {
+                std::memcpy(out + decoded.levels[i - base].offset, image.levels[i].data.data(), image.levels[i].data.size());
+            }
+
+            decoded.format = image.format;
+            decoded.width = level.width;
+            decoded.height = level.height;
+
+            return;
+        }
+
+        // the device can't sample it, expand the base level and carry on like any other image
+        w = std::min(w, level.width);
+        h = std::min(h, level.height);
+
+        std::vector<unsigned char> full;
+        unsigned char* out;
+
+        if (w != level.width || h != level.height) {
+            full.resize(size_t(level.width) * level.height * 4);
+            tau::decompress(image.format, level.data.data(), level.width, level.height, full.data());
+
+            out = output(decoded, staging, size_t(w) * h * 4);
+            if (out) tau::resample(full.data(), level.width, level.height, out, w, h);
+        } else {
+            out = output(decoded, staging, size_t(w) * h * 4);
+            if (out) tau::decompress(image.format, level.data.data(), w, h, out);
+        }
+
+        if (!out) return;
+
+        decoded.width = w;
+        decoded.height = h;
+    }
+}
+
+tau::DecodedImage tau::decodeImage(const std::string& path, StagingRing& staging, uint32_t width, uint32_t height, std::span<const vk::Format> compressed) {
+    DecodedImage decoded;
+    decoded.key = path;
+
+    if (endsWith(path, ".ktx2") || endsWith(path, ".dds")) {
+        MappedFile file(path);
+        if (!file.valid()) return decoded;
+
+        auto image = parseCompressed(file.bytes());
+        if (image) decodeCompressed(decoded, *image, staging, width, height, compressed);
+
+        return decoded;
+    }
+
+    int x;
+    int y;
+    int channels;
+
+    if (!stbi_info(path.c_str(), &x, &y, &channels)) return decoded;
+
+    auto[w, h] = fitResolution(x, y, width, height);
+    bool scaled = w != uint32_t(x) || h != uint32_t(y);
+
+    size_t size = size_t(w) * h * STBI_rgb_alpha;
+
+    // leave most of the ring to the render thread, a few big decodes shouldn't starve it
+    std::optional<StagingRange> range;
+    if (size + 1 <= staging.capacity / 4) range = staging.reserve(size + 1);
+
+    // a scaled image goes through the heap at full size first and is resampled into the ring
+    if (range && !scaled) sink = { .data = range->mapped, .size = size, .armed = true };
+
+    auto data = stbi_load(path.c_str(), &x, &y, &channels, STBI_rgb_alpha);
+
+    bool direct = range && data && !scaled && data == range->mapped && sink.taken;
+
+    sink = {};
+
+    if (data && scaled) {
+        auto out = range ? static_cast<unsigned char*>(range->mapped) : static_cast<unsigned char*>(std::malloc(size));
+
+        if (out) resample(data, x, y, out, w, h);
+
+        stbi_image_free(data);
+
+        if (!out) return decoded;
+
+        decoded.width = w;
+        decoded.height = h;
+
+        if (range) decoded.staged = range;
+        else decoded.pixels = { out, [](void* p) { std::free(p); } };
+
+        return decoded;
+    }
+
+    if (range && !direct) staging.commit(*range, 0);
+
+    if (!data) return decoded;
+
+    decoded.width = x;
+    decoded.height = y;
+
+    if (direct) decoded.staged = range;
+    else decoded.pixels = { data, stbi_image_free };
+
+    return decoded;
+}
+
+std::pair<uint32_t, uint32_t> tau::fitResolution(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t width, uint32_t height) {
+    if (width == 0 && height == 0) return { sourceWidth, sourceHeight };
+
+    if (width == 0) width = std::max<uint32_t>(uint64_t(sourceWidth) * height / sourceHeight, 1);
+    if (height == 0) height = std::max<uint32_t>(uint64_t(sourceHeight) * width / sourceWidth, 1);
+
+    return { std::min(width, sourceWidth), std::min(height, sourceHeight) };
+}
+
+namespace {
+    // how one source texel/row splits over the output: all of it goes to `first` unless it
+    // straddles a boundary, then `second` of it spills into first + 1
+    struct Footprint {
+        uint32_t first;
+        float weight;
+        float spill;
+    };
+
+    std::vector<Footprint> footprints(uint32_t src, uint32_t dst) {
+        std::vector<Footprint> fp(src);
+
+        // one source texel covers `scale` of an output texel, weights sum to 1 per output texel
+        double scale = double(dst) / src;
+
+        for (uint32_t i = 0; i < src; ++i) {
+            double begin = i * scale;
+            double end = (i + 1) * scale;
+
+            auto first = std::min(uint32_t(begin), dst - 1);
+            double boundary = first + 1.0;
+
+            if (end > boundary && first + 1 < dst) fp[i] = { first, float(boundary - begin), float(end - boundary) };
+            else fp[i] = { first, float(end - begin), 0.0f };
+        }
+
+        return fp;
+    }
+}
+
+void tau::resample(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight, unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight) {
+    auto columns = footprints(srcWidth, dstWidth);
+    auto rows = footprints(srcHeight, dstHeight);
+
+    // one horizontally reduced source row, the output row being built and the one after it
+    std::vector<float> row(size_t(dstWidth) * 4);
+    std::vector<float> acc(size_t(dstWidth) * 4, 0.0f);
+    std::vector<float> next(size_t(dstWidth) * 4, 0.0f);
+
+    uint32_t current = 0;
+
+    auto emit = [&] {
+        auto out = dst + size_t(current) * dstWidth * 4;
+
+        for (size_t i = 0; i < acc.size(); ++i) out[i] = static_cast<unsigned char>(std::clamp(acc[i] + 0.5f, 0.0f, 255.0f));
+
+        acc.swap(next);
+        std::fill(next.begin(), next.end(), 0.0f);
+        ++current;
+    };
+
+    for (uint32_t y = 0; y < srcHeight; ++y) {
+        std::fill(row.begin(), row.end(), 0.0f);
+
+        auto in = src + size_t(y) * srcWidth * 4;
+
+        for (uint32_t x = 0; x < srcWidth; ++x) {
+            auto& c = columns[x];
+            auto r = &row[size_t(c.first) * 4];
+
+            for (int k = 0; k < 4; ++k) r[k] += in[x * 4 + k] * c.weight;
+
+            if (c.spill > 0.0f) {
+                for (int k = 0; k < 4; ++k) r[4 + k] += in[x * 4 + k] * c.spill;
+            }
+        }
+
+        auto& r = rows[y];
+
+        while (current < r.first) emit();
+
+        for (size_t i = 0; i < row.size(); ++i) acc[i] += row[i] * r.weight;
+
+        if (r.spill > 0.0f) {
+            for (size_t i = 0; i < row.size(); ++i) next[i] += row[i] * r.spill;
+        }
+    }
+
+    while (current < dstHeight) emit();
+}
+
+void tau::downsample(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst) {
+    uint32_t w = std::max(width / 2, 1u);
+    uint32_t h = std::max(height / 2, 1u);
+
+    // the source texels under output texel i, the last one of an odd axis takes three
+    auto taps = [](uint32_t i, uint32_t out, uint32_t size, uint32_t(&t)[3]) -> uint32_t {
+        if (size == 1) {
+            t[0] = 0;
+            return 1;
+        }
+
+        t[0] = i * 2;
+        t[1] = i * 2 + 1;
+        t[2] = i * 2 + 2;
+
+        return i + 1 == out && size % 2 ? 3 : 2;
+    };
+
+    uint32_t ty[3];
+    uint32_t tx[3];
+
+    for (uint32_t y = 0; y < h; ++y) {
+        auto ny = taps(y, h, height, ty);
+
+        for (uint32_t x = 0; x < w; ++x) {
+            auto nx = taps(x, w, width, tx);
+            auto n = ny * nx;
+
+            for (uint32_t c = 0; c < 4; ++c) {
+                unsigned sum = 0;
+
+                for (uint32_t j = 0; j < ny; ++j) {
+                    for (uint32_t k = 0; k < nx; ++k) sum += src[(size_t(ty[j]) * width + tx[k]) * 4 + c];
+                }
+
+                dst[(size_t(y) * w + x) * 4 + c] = static_cast<unsigned char>((sum + n / 2) / n);
+            }
+        }
+    }
+}
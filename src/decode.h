@@ -0,0 +1,62 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "staging.h"
+
+namespace tau {
+    // pixels fresh off a worker thread, turned into a texture on the render thread; when the
+    // decoder could write straight into the staging ring `staged` holds them and `pixels` is empty
+    //
+    // RGBA8 unless the file was block compressed in a format the device samples, then `levels`
+    // lists the mip chain back to back as it came out of the file
+    struct DecodedImage {
+        struct Level {
+            size_t offset;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        std::string key;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        vk::Format format = vk::Format::eR8G8B8A8Unorm;
+        std::vector<Level> levels;
+        std::unique_ptr<unsigned char, void(*)(void*)> pixels{ nullptr, nullptr };
+        std::optional<StagingRange> staged;
+
+        bool valid() const { return pixels || staged; }
+    };
+
+    // a non-zero width or height scales the image down on the way, see fitResolution; .ktx2 and
+    // .dds files keep their block format if it is in `compressed`, and are expanded to RGBA8 if not
+    DecodedImage decodeImage(const std::string& path, StagingRing& staging, uint32_t width = 0, uint32_t height = 0, std::span<const vk::Format> compressed = {});
+
+    // the size an image ends up at when asked for `width` x `height`: never bigger than the source,
+    // and a zero axis follows the other one's scale
+    std::pair<uint32_t, uint32_t> fitResolution(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t width, uint32_t height);
+
+    // area average RGBA8 downscale, every source texel lands in the output with its exact coverage
+    void resample(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight, unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight);
+
+    // halves an RGBA8 image with a 2x2 box filter, the odd row or column of an odd axis is
+    // averaged into the last texel as a third tap
+    void downsample(const unsigned char* src, uint32_t width, uint32_t height, unsigned char* dst);
+
+    namespace detail {
+        // stb_image's allocator, see stb_implementation.cpp
+        void* stbi_malloc(size_t size);
+        void* stbi_realloc(void* p, size_t size);
+        void stbi_free(void* p);
+    }
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "instance.h"
 #include "dom.h"
 
+#include <utility>
+
 /* vk::raii::DescriptorSetLayout Gradient::createDescriptorSetLayout(Instance &i) {
     vk::DescriptorSetLayoutBinding dslb{};
     dslb.binding = 0;
@@ -30,35 +32,111 @@ void tau::Component::element::render(tau::Instance& instance, int current_frame,
 }
 
 void tau::span::element::render(Instance& instance, int current_frame, vk::raii::CommandBuffer& cmd) {
-    
+    if (!font) font = instance.getFont(fontPath);
+
+    // glyphs go onto the atlas as they are first drawn, nothing is rasterized ahead of time
+    instance.drawText(cmd, *font, text, static_cast<float>(bounds.left), static_cast<float>(bounds.top));
 }
 
 void tau::text::element::render(Instance& instance, int current_frame, vk::raii::CommandBuffer& cmd) {
     
 }
 
-tau::elements tau::operator|(std::unique_ptr<element>&& left, std::unique_ptr<element>&& right) {
-    elements els;
+tau::elements tau::operator|(ptr<element>&& left, ptr<element>&& right) {
+    elements els{ arenaResource() };
     els.push_back(std::move(left));
     els.push_back(std::move(right));
 
     return els;
 }
 
-tau::elements tau::operator|(elements&& left, std::unique_ptr<element>&& right) {
+tau::elements tau::operator|(elements&& left, ptr<element>&& right) {
     left.push_back(std::move(right));
 
     return left;
 }
 
+tau::ImageRef::ImageRef(CombinedImage* entry) : entry(entry) {
+    if (entry) ++entry->refs;
+}
+
+tau::ImageRef::ImageRef(const ImageRef& other) : ImageRef(other.entry) {}
+
+tau::ImageRef& tau::ImageRef::operator=(const ImageRef& other) {
+    if (this != &other) *this = ImageRef(other);
+
+    return *this;
+}
+
+tau::ImageRef::ImageRef(ImageRef&& other) noexcept : entry(std::exchange(other.entry, nullptr)) {}
+
+tau::ImageRef& tau::ImageRef::operator=(ImageRef&& other) noexcept {
+    if (this == &other) return *this;
+
+    release();
+    entry = std::exchange(other.entry, nullptr);
+
+    return *this;
+}
+
+tau::ImageRef::~ImageRef() {
+    release();
+}
+
+void tau::ImageRef::release() {
+    if (!entry) return;
+
+    // the eviction clock starts once the last element lets go, from the last frame that could
+    // have drawn it
+    if (--entry->refs == 0) entry->lastUsed = Instance::current_instance->framesSubmitted;
+
+    entry = nullptr;
+}
+
 void tau::ImageBG::init() {
-    image = Instance::current_instance->getImage(src);
+    auto& instance = *Instance::current_instance;
+
+    image = ImageRef(instance.getImage(src, resolution));
+
+    SamplerKey key;
+
+    if (filter == Filter::nearest) {
+        key.filter = vk::Filter::eNearest;
+        key.mipmap = vk::SamplerMipmapMode::eNearest;
+    }
+
+    sampler = instance.getSampler(key);
+}
+
+void tau::ImageBG::write_to(char*& p) const {
+    while (((size_t)p & 0b1111) != 0) ++p;
+
+    *(color*)p = placeholder;
+
+    p += 16;
+
+    // offset and scale of the image's rectangle on its atlas page, the whole texture otherwise
+    *(vec2*)p = image->uvOffset;
+    *(vec2*)(p + 8) = image->uvScale;
+
+    p += 16;
+
+    while (((size_t)p & 0b11) != 0) ++p;
+
+    *(float*)p = Instance::current_instance->resident(image->img) ? 1.0f : 0.0f;
+
+    p += 4;
 }
 
 void tau::ImageBG::write_bindings(size_t &n, vk::raii::Device &device, vk::raii::DescriptorSet &set) {
+    auto& instance = *Instance::current_instance;
+
+    // still on its way through the transfer queue
+    auto& view = instance.resident(image->img) ? image->view() : instance.placeholder.view;
+
     vk::DescriptorImageInfo info{};
-    info.sampler = *image->sampler;
-    info.imageView = *image->img.view;
+    info.sampler = sampler;
+    info.imageView = *view;
     info.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 
     vk::WriteDescriptorSet wds{};
@@ -85,12 +163,76 @@ tau::Box tau::SpanLayout::layout(Box av, element &el) const {
     return Box();
 }
 
-std::unique_ptr<tau::span::element> tau::span::operator()(std::string txt) {
-    auto e = std::make_unique<element>();
+bool tau::element::fixedSize() const {
+    // blocks, flex containers and grids always fill the width they're given
+    if (auto block = std::get_if<BlockLayout>(&layout)) return block->dimensions.y.has_value();
+    if (auto flex = std::get_if<FlexLayout>(&layout)) return flex->dimensions.y.has_value();
+    if (auto grid = std::get_if<GridLayout>(&layout)) return grid->dimensions.y.has_value();
+
+    return true;
+}
+
+void tau::element::invalidate() {
+    layoutDirty = true;
+    forgetMeasures();
+
+    // the parent of a changed node always has to place it again
+    bool resize = true;
+
+    for (auto e = parent; e; e = e->parent) {
+        e->forgetMeasures();
+
+        if (resize) {
+            e->layoutDirty = true;
+            resize = !e->fixedSize();
+        } else if (e->childDirty) {
+            // everything above is already marked
+            break;
+        }
+
+        e->childDirty = true;
+    }
+}
+
+void tau::element::setLayout(Layout l) {
+    // switching between kinds changes which children the layout tree flattens
+    if (l.index() != layout.index()) childrenChanged = true;
+
+    layout = std::move(l);
+    invalidate();
+}
+
+void tau::element::setChildren(elements&& els) {
+    children = std::move(els);
+
+    for (auto& c : children) c->parent = this;
+
+    childrenChanged = true;
+    invalidate();
+}
+
+void tau::shiftChildren(element& el, uint32_t dx, uint32_t dy) {
+    for (auto& c : el.children) {
+        c->bounds.left += dx;
+        c->bounds.top += dy;
+        c->content.left += dx;
+        c->content.top += dy;
+
+        shiftChildren(*c, dx, dy);
+    }
+}
+
+void tau::span::element::setText(std::string txt) {
+    text = std::move(txt);
+    invalidate();
+}
+
+tau::ptr<tau::span::element> tau::span::operator()(std::string txt) {
+    auto e = make<element>();
 
-    e->layout = std::make_unique<SpanLayout>();
+    e->layout = SpanLayout{};
     e->text = std::move(txt);
-    e->font = Instance::current_instance->getFont(font);
+    e->fontPath = font;
 
     return e;
 }
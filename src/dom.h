@@ -1,16 +1,20 @@
 #ifndef DOM_H
 #define DOM_H
 
+#include <array>
 #include <functional>
+#include <limits>
 #include <sstream>
 #include <optional>
 #include <typeindex>
+#include <variant>
 #include <sstream>
 #include <memory>
 #include <vulkan/vulkan_raii.hpp>
 #include <iostream>
 #include <string>
 
+#include "arena.h"
 #include "box.h"
 #include "quantities.h"
 
@@ -295,27 +299,72 @@ namespace tau {
         static void poolSizes(std::vector<vk::DescriptorPoolSize>& pss) {}
     };
 
+    enum class Filter {
+        linear,
+        nearest
+    };
+
+    // keeps an image cache entry from being evicted for as long as an element holds on to it
+    class ImageRef {
+    public:
+        ImageRef() = default;
+        explicit ImageRef(CombinedImage* entry);
+
+        ImageRef(const ImageRef& other);
+        ImageRef& operator=(const ImageRef& other);
+        ImageRef(ImageRef&& other) noexcept;
+        ImageRef& operator=(ImageRef&& other) noexcept;
+
+        ~ImageRef();
+
+        CombinedImage* operator->() const { return entry; }
+        CombinedImage& operator*() const { return *entry; }
+        CombinedImage* get() const { return entry; }
+
+    private:
+        void release();
+
+        CombinedImage* entry = nullptr;
+    };
+
     struct ImageBG : Style {
         std::string src;
-        tau::CombinedImage* image;
+        color placeholder = 0x00000000;
+        // decoded straight to this size when the source is bigger, 0 keeps the aspect ratio of the
+        // other axis and { 0, 0 } the source size
+        ivec2 resolution = { 0, 0 };
+        // nearest keeps pixel art crisp, it also picks the closest mip instead of blending two
+        Filter filter = Filter::linear;
+        ImageRef image;
+        vk::Sampler sampler;
 
         void init();
 
         static void code(size_t& n, std::ostringstream& code, std::ostringstream& functions, std::ostringstream& ubo) {
             functions << "layout(binding = 1) uniform sampler2D Sampler;\n";
 
-            code << "outColor = texture(Sampler, uv);\n";
+            code << "outColor = ubo.image_loaded" << n << " > 0.5 ? texture(Sampler, ubo.image_uv" << n << ".xy + uv * ubo.image_uv" << n << ".zw) : ubo.image_placeholder" << n << ";\n";
+
+            ubo << "vec4 image_placeholder" << n << ";\n";
+            ubo << "vec4 image_uv" << n << ";\n";
+            ubo << "float image_loaded" << n << ";\n";
 
             ++n;
         }
 
         static size_t size(size_t n) {
+            while ((n & 0b1111) != 0) ++n;
+
+            n += 32;
+
+            while ((n & 0b11) != 0) ++n;
+
+            n += 4;
+
             return n;
         }
 
-        void write_to(char*& p) const {
-            
-        }
+        void write_to(char*& p) const;
 
         static void bindings(std::vector<vk::DescriptorSetLayoutBinding>& bindings) {
             vk::DescriptorSetLayoutBinding dslb{};
@@ -333,209 +382,355 @@ namespace tau {
     };
 
     struct element;
-    
-    struct Layout {
-        template<typename T>
-        bool is() const {
-            return dynamic_cast<const T*>(this) != nullptr;
-        }
 
-        template<typename T>
-        T* to() {
-            return dynamic_cast<T*>(this);
-        }
+    // the layout kinds are a closed set, stored inline in every element and dispatched by
+    // layoutElement below
+    struct BlockLayout {
+        Quantity2D dimensions;
+        Quantity2D padding;
+        Quantity2D margin;
 
-        virtual Box layout(Box, element& el) const = 0;
+        Box layout(Box available, element& el) const;
     };
-    
-    struct Cascade {
-        const char* font;
-        int font_size;
+
+    enum class FlexDirection {
+        row,
+        column
     };
 
-    struct element {
-        Box bounds;
-        Box content;
-        std::unique_ptr<Layout> layout;
-        std::vector<std::unique_ptr<element>> children;
+    enum class Justify {
+        start,
+        end,
+        center,
+        spaceBetween,
+        spaceAround,
+        spaceEvenly
+    };
 
-        virtual void render(Instance& instance, int current_frame, vk::raii::CommandBuffer&) = 0;
+    enum class Align {
+        start,
+        end,
+        center,
+        stretch
     };
-    
-    using elements = std::vector<std::unique_ptr<element>>;
 
-    struct Block {
+    // how an element behaves as the child of a flex container
+    struct FlexItem {
+        float grow = 0;
+        float shrink = 1;
+        std::optional<Quantity> basis;
+        std::optional<Align> alignSelf;
+    };
+
+    struct FlexLayout {
         Quantity2D dimensions;
         Quantity2D padding;
         Quantity2D margin;
+        FlexDirection direction = FlexDirection::row;
+        bool wrap = false;
+        Justify justify = Justify::start;
+        Align align = Align::stretch;
+        std::optional<Quantity> gap;
 
-        struct Impl : Layout {
-            Quantity2D dimensions;
-            Quantity2D padding;
-            Quantity2D margin;
+        Box layout(Box available, element& el) const;
 
-            Box layout(Box available, element& el) const {
-                Box b = available;
+        // `place` false only works out the size, children are measured but not laid out
+        Box run(Box available, element& el, bool place) const;
+    };
 
-                if (dimensions.x.has_value()) b.width = dimensions.x.value().pixels_relative_to(available.width);
+    struct SpanLayout {
+        Box layout(Box av, element& el) const;
+    };
 
-                if (dimensions.y.has_value()) b.height = dimensions.y.value().pixels_relative_to(available.width);
+    // where an element goes in a grid: cells with a row are placed first, at their column or in
+    // the first columns of that row they fit in; the rest follow in order from a cursor that
+    // only moves forward, to the next spot in row-major order no placed cell covers, and a cell
+    // with just a column goes down to the next row where that column is free
+    struct GridItem {
+        std::optional<uint16_t> row;
+        std::optional<uint16_t> column;
+        uint16_t rowSpan = 1;
+        uint16_t columnSpan = 1;
+    };
 
-                Box contentAv = b;
+    // track sizes and cell placement from the last layout of one grid element, so only the rows
+    // touched by a changed cell have to be measured again
+    struct GridCache {
+        struct Cell {
+            uint32_t row;
+            uint32_t column;
+            uint32_t rowSpan;
+            uint32_t columnSpan;
 
-                contentAv.left += margin.x.value_or(0_px).pixels_relative_to(available.width);
-                contentAv.left += padding.x.value_or(0_px).pixels_relative_to(b.width);
+            bool operator==(const Cell&) const = default;
+        };
 
-                contentAv.width -= 2 * margin.x.value_or(0_px).pixels_relative_to(available.width);
-                contentAv.width -= 2 * padding.x.value_or(0_px).pixels_relative_to(b.width);
+        // what the column offsets were worked out from
+        uint32_t width = std::numeric_limits<uint32_t>::max();
+        uint32_t spacing = 0;
+        std::vector<Quantity> columns;
 
-                contentAv.top += margin.y.value_or(0_px).pixels_relative_to(available.width);
-                contentAv.top += padding.y.value_or(0_px).pixels_relative_to(b.width);
+        // one entry per track plus the end, each including the gap after it
+        std::vector<uint32_t> columnOffsets;
+        std::vector<uint32_t> rowOffsets;
 
-                contentAv.height -= 2 * margin.y.value_or(0_px).pixels_relative_to(available.width);
-                contentAv.height -= 2 * padding.y.value_or(0_px).pixels_relative_to(b.width);
+        // the tallest single-row cell in each row
+        std::vector<uint32_t> rowContent;
+        std::vector<Cell> cells;
 
-                for (size_t i = 0; i < el.children.size(); ++i) {
-                    el.children[i]->bounds = el.children[i]->layout->layout(contentAv, *el.children[i]);
-                    
-                    contentAv.top += el.children[i]->bounds.height;
-                    // contentAv.height -= el.children[i]->bounds.height;
-                }
+        // the element each cell was worked out for
+        std::vector<const element*> owners;
+    };
 
-                if (!dimensions.y.has_value()) b.height = contentAv.top + margin.y.value_or(0_px).pixels_relative_to(available.width) + padding.y.value_or(0_px).pixels_relative_to(b.width);
+    // tracks are pixels, percentages of the grid's width or fractions (_fr) of what is left;
+    // rows past the explicit ones, and fractional rows in a grid without a height, fit their cells
+    struct GridLayout {
+        Quantity2D dimensions;
+        Quantity2D padding;
+        Quantity2D margin;
+        std::vector<Quantity> columns;
+        std::vector<Quantity> rows;
+        std::optional<Quantity> gap;
 
-                el.content = b;
+        Box layout(Box available, element& el) const;
+        Box run(Box available, element& el, bool place) const;
+    };
 
-                el.content.left += margin.x.value_or(0_px).pixels_relative_to(available.width);
-                el.content.width -= 2 * margin.x.value_or(0_px).pixels_relative_to(available.width);
+    // monostate is an element without a layout, it takes the width it is given and no height
+    using Layout = std::variant<std::monostate, BlockLayout, FlexLayout, SpanLayout, GridLayout>;
+    
+    struct Cascade {
+        const char* font;
+    };
 
-                el.content.top += margin.y.value_or(0_px).pixels_relative_to(available.width);
-                el.content.height -= 2 * margin.y.value_or(0_px).pixels_relative_to(available.width);
+    using elements = std::pmr::vector<ptr<element>>;
 
-                return b;
-            }
+    struct element {
+        Box bounds;
+        Box content;
+        Layout layout;
+        FlexItem item;
+        GridItem cell;
+        elements children{ arenaResource() };
+        element* parent = nullptr;
+
+        // the last sizes measureElement worked out for this node, keyed by what it was given
+        struct Measure {
+            uint32_t width;
+            uint32_t forceWidth;
+            uint32_t forceHeight;
+            Box size;
         };
 
-        operator std::unique_ptr<Layout>() const {
-            auto impl = std::make_unique<Impl>();
+        std::array<Measure, 2> measures;
+        uint8_t measureCount = 0;
+        uint8_t measureNext = 0;
 
-            impl->dimensions = dimensions;
-            impl->padding = padding;
-            impl->margin = margin;
+        // kept by the element rather than its layout, which is a plain value that gets copied
+        std::unique_ptr<GridCache> gridCache;
 
-            return impl;
+        void forgetMeasures() {
+            measureCount = 0;
+            measureNext = 0;
         }
-    };
 
-    struct Horizontal {
+        // layoutDirty: this node has to be laid out again, childDirty: something below it does;
+        // childrenChanged means the layout tree has to be flattened again before that
+        bool layoutDirty = true;
+        bool childDirty = false;
+        bool childrenChanged = false;
+
+        // whether the size of this node can't depend on its children
+        bool fixedSize() const;
+
+        // marks this node and every ancestor whose size may change with it, the ones above the
+        // nearest fixed-size node are only marked childDirty
+        void invalidate();
+
+        void setLayout(Layout l);
+        void setChildren(elements&& els);
 
+        virtual void render(Instance& instance, int current_frame, vk::raii::CommandBuffer&) = 0;
+
+        virtual ~element() = default;
     };
 
-    struct Flex {
-        Quantity2D dimensions;
-        Quantity2D padding;
-        Quantity2D margin;
+    inline Box layoutWith(const Layout& layout, Box available, element& el) {
+        switch (layout.index()) {
+        case 1:
+            return std::get_if<BlockLayout>(&layout)->layout(available, el);
+        case 2:
+            return std::get_if<FlexLayout>(&layout)->layout(available, el);
+        case 3:
+            return std::get_if<SpanLayout>(&layout)->layout(available, el);
+        case 4:
+            return std::get_if<GridLayout>(&layout)->layout(available, el);
+        default:
+            return { .left = available.left, .top = available.top, .width = available.width, .height = 0 };
+        }
+    }
 
-        struct Impl : Layout {
-            Quantity2D dimensions;
-            Quantity2D padding;
-            Quantity2D margin;
+    inline Box layoutElement(Box available, element& el) {
+        auto b = layoutWith(el.layout, available, el);
 
-            Box preferredLayout(Box b, const std::span<std::unique_ptr<element>> els) const {
-                // left-to-right
+        el.layoutDirty = false;
+        el.childDirty = false;
 
-                // css-flexbox-1 9.2: available main and cross space
-                Box available;
+        return b;
+    }
 
-                if (dimensions.x.has_value()) available.width = dimensions.x.value().pixels_relative_to(b.width);
-                else {
+    constexpr uint32_t unsized = std::numeric_limits<uint32_t>::max();
 
-                }
+    // moves every box below `el` by dx, dy, for a layout that would put its children exactly where
+    // they were relative to it; unsigned wrap-around makes adding the same as subtracting
+    void shiftChildren(element& el, uint32_t dx, uint32_t dy);
 
-                if (dimensions.y.has_value()) available.height = dimensions.y.value().pixels_relative_to(b.width);
-                else available.height = std::numeric_limits<uint32_t>::max();
+    // `layout` with its width and height fixed to the given pixel sizes where they aren't `unsized`,
+    // how a flex container makes an item take the size it worked out for it
+    Layout sizedLayout(const Layout& layout, uint32_t width, uint32_t height);
 
-                available.width -= 2 * padding.x.value_or(0_px).pixels_relative_to(b.width);
-                available.width -= 2 * margin.x.value_or(0_px).pixels_relative_to(b.width);
+    // the size `el` would lay out to at the origin of a `width` x `height` box, without laying out
+    // anything; cached on the element until it is invalidated
+    Box measureElement(element& el, uint32_t width, uint32_t height, uint32_t forceWidth = unsized, uint32_t forceHeight = unsized);
 
-                available.height -= 2 * padding.y.value_or(0_px).pixels_relative_to(b.width);
-                available.height -= 2 * margin.y.value_or(0_px).pixels_relative_to(b.width);
+    inline Box BlockLayout::layout(Box available, element& el) const {
+        Box b = available;
 
-                uint32_t max_h = 0;
-                uint32_t width = 0;
+        if (dimensions.x.has_value()) b.width = dimensions.x.value().pixels_relative_to(available.width);
 
-                for (size_t i = 0; i < els.size(); ++i) {
-                    /* auto box = els[i]->layout->layout({
-                        .width = b.width - 2 * padding.x.value_or(0_px).pixels_relative_to(width) - 2 * margin.x.value_or(0_px).pixels_relative_to(b.width) - width,
-                        .height = b.height - 2 * padding.y.value_or(0_px).pixels_relative_to(width) - 2 * margin.y.value_or(0_px).pixels_relative_to(b.height)
-                    }, );
+        if (dimensions.y.has_value()) b.height = dimensions.y.value().pixels_relative_to(available.width);
 
-                    width += box.width;
+        Box contentAv = b;
 
-                    if (box.height > max_h) max_h = box.height; */
-                }
+        contentAv.left += margin.x.value_or(0_px).pixels_relative_to(available.width);
+        contentAv.left += padding.x.value_or(0_px).pixels_relative_to(b.width);
 
-                if (dimensions.x.has_value()) width = dimensions.x.value().value;
-                if (dimensions.y.has_value()) max_h = dimensions.y.value().value;
+        contentAv.width -= 2 * margin.x.value_or(0_px).pixels_relative_to(available.width);
+        contentAv.width -= 2 * padding.x.value_or(0_px).pixels_relative_to(b.width);
 
-                width += 2 * padding.x.value_or(0_px).pixels_relative_to(width);
-                max_h += 2 * padding.y.value_or(0_px).pixels_relative_to(width);
+        contentAv.top += margin.y.value_or(0_px).pixels_relative_to(available.width);
+        contentAv.top += padding.y.value_or(0_px).pixels_relative_to(b.width);
 
-                width += 2 * margin.x.value_or(0_px).pixels_relative_to(b.width);
-                max_h += 2 * margin.y.value_or(0_px).pixels_relative_to(b.height);
+        contentAv.height -= 2 * margin.y.value_or(0_px).pixels_relative_to(available.width);
+        contentAv.height -= 2 * padding.y.value_or(0_px).pixels_relative_to(b.width);
 
-                return {
-                    .width = width,
-                    .height = max_h
-                };
-            }
-    
-            Box layout(Box, element&) const {
-                return Box{ .left = 10, .top = 10, .width = 200, .height = 50 };
-            }
-        };
+        for (size_t i = 0; i < el.children.size(); ++i) {
+            el.children[i]->bounds = layoutElement(contentAv, *el.children[i]);
+            
+            contentAv.top += el.children[i]->bounds.height;
+            // contentAv.height -= el.children[i]->bounds.height;
+        }
+
+        if (!dimensions.y.has_value()) b.height = contentAv.top - b.top + margin.y.value_or(0_px).pixels_relative_to(available.width) + padding.y.value_or(0_px).pixels_relative_to(b.width);
 
-        operator std::unique_ptr<Layout>() const {
-            auto impl = std::make_unique<Impl>();
+        el.content = b;
 
-            impl->dimensions = dimensions;
-            impl->padding = padding;
-            impl->margin = margin;
+        el.content.left += margin.x.value_or(0_px).pixels_relative_to(available.width);
+        el.content.width -= 2 * margin.x.value_or(0_px).pixels_relative_to(available.width);
+
+        el.content.top += margin.y.value_or(0_px).pixels_relative_to(available.width);
+        el.content.height -= 2 * margin.y.value_or(0_px).pixels_relative_to(available.width);
+
+        return b;
+    }
 
-            return impl;
+    struct Block {
+        Quantity2D dimensions;
+        Quantity2D padding;
+        Quantity2D margin;
+
+        using Impl = BlockLayout;
+
+        operator Layout() const {
+            return BlockLayout{ .dimensions = dimensions, .padding = padding, .margin = margin };
         }
     };
 
-    struct SpanLayout : Layout {
-        Box layout(Box av, element& el) const;
+    struct Horizontal {
+
+    };
+
+    struct Flex {
+        Quantity2D dimensions;
+        Quantity2D padding;
+        Quantity2D margin;
+
+        FlexDirection direction = FlexDirection::row;
+        bool wrap = false;
+        Justify justify = Justify::start;
+        Align align = Align::stretch;
+        std::optional<Quantity> gap;
+
+        using Impl = FlexLayout;
+
+        operator Layout() const {
+            return FlexLayout{
+                .dimensions = dimensions,
+                .padding = padding,
+                .margin = margin,
+                .direction = direction,
+                .wrap = wrap,
+                .justify = justify,
+                .align = align,
+                .gap = gap
+            };
+        }
+    };
+
+    struct Grid {
+        Quantity2D dimensions;
+        Quantity2D padding;
+        Quantity2D margin;
+        std::vector<Quantity> columns;
+        std::vector<Quantity> rows;
+        std::optional<Quantity> gap;
+
+        using Impl = GridLayout;
+
+        operator Layout() const {
+            return GridLayout{
+                .dimensions = dimensions,
+                .padding = padding,
+                .margin = margin,
+                .columns = columns,
+                .rows = rows,
+                .gap = gap
+            };
+        }
     };
 
     struct PipelineCacheEntry;
 
     #define element_props \
-    std::unique_ptr<Layout> layout; \
+    Layout layout; \
     Shader style; \
+    FlexItem item; \
+    GridItem cell; \
 
     template<typename Shader = Default>
     struct view {
         element_props
 
         struct element : ::tau::element {
-            PipelineCacheEntry* pipeline;
+            // the pipeline and whatever the style loads are only resolved on the first render, so
+            // a tree can be built and laid out without an Instance
+            PipelineCacheEntry* pipeline = nullptr;
             Shader style;
 
             void render(Instance& instance, int current_frame, vk::raii::CommandBuffer&);
         };
 
-        std::unique_ptr<element> operator ()(elements&& els = elements{}) {
-            auto e = std::make_unique<element>();
+        ptr<element> operator ()(elements&& els = elements{ arenaResource() }) {
+            auto e = make<element>();
 
-            e->pipeline = Instance::current_instance->template get_shader<Shader>();
             e->layout = std::move(layout);
             e->style = std::move(style);
-            e->style.init();
+            e->item = item;
+            e->cell = cell;
             e->children = std::move(els);
 
+            for (auto& c : e->children) c->parent = e.get();
+
             return e;
         }
     };
@@ -545,12 +740,17 @@ namespace tau {
 
         struct element : tau::element {
             std::string text;
-            Font* font;
+            std::string fontPath;
+
+            // loaded on the first render, same as a view's pipeline
+            Font* font = nullptr;
+
+            void setText(std::string txt);
 
             void render(Instance& instance, int current_frame, vk::raii::CommandBuffer&);
         };
 
-        std::unique_ptr<element> operator ()(std::string txt);
+        ptr<element> operator ()(std::string txt);
     };
 
     struct text {
@@ -562,8 +762,8 @@ namespace tau {
 
     struct Component {
         struct element : tau::element {
-            std::function<std::unique_ptr<tau::element>()> render_func;
-            std::unique_ptr<tau::element> child;
+            std::function<ptr<tau::element>()> render_func;
+            ptr<tau::element> child;
             std::type_index type = typeid(void);
 
             void render(Instance& instance, int current_frame, vk::raii::CommandBuffer&);
@@ -600,8 +800,8 @@ namespace tau {
         static auto render = std::move(r);
 
         struct DerivedComponent : Component {
-            inline std::unique_ptr<element> operator ()(T&& t) const {
-                std::unique_ptr<element> c = std::make_unique<element>();
+            inline ptr<element> operator ()(T&& t) const {
+                ptr<element> c = make<element>();
 
                 // std::cerr << "hey\n";
 
@@ -611,8 +811,8 @@ namespace tau {
                 Component::current_component = c.get();
 
                 if constexpr (!std::is_same_v<T, std::monostate>) {
-                    c->render_func = [arg = std::move(t), ptr = c.get(), r = render]() mutable -> std::unique_ptr<tau::element> { Component::current_component = ptr; return r(arg); }; // std::bind(render, std::move(t));
-                } else c->render_func = [ptr = c.get(), r = render]() mutable -> std::unique_ptr<tau::element> { Component::current_component = ptr; return r(); };// render;
+                    c->render_func = [arg = std::move(t), self = c.get(), r = render]() mutable -> ptr<tau::element> { Component::current_component = self; return r(arg); }; // std::bind(render, std::move(t));
+                } else c->render_func = [self = c.get(), r = render]() mutable -> ptr<tau::element> { Component::current_component = self; return r(); };// render;
                 c->type = typeid(render);
                 /* c->render = [; */
 
@@ -646,8 +846,8 @@ namespace tau {
         cmd.draw(6, 1, 0, 0);
     } */
 
-    elements operator | (std::unique_ptr<element>&&, std::unique_ptr<element>&&);
-    elements operator | (elements&&, std::unique_ptr<element>&&);
+    elements operator | (ptr<element>&&, ptr<element>&&);
+    elements operator | (elements&&, ptr<element>&&);
 }
 
 #endif
\ No newline at end of file
@@ -6,6 +6,11 @@
 namespace tau {
     template<typename Shader>
     void view<Shader>::element::render(Instance& instance, int current_frame, vk::raii::CommandBuffer& cmd) {
+        if (!pipeline) {
+            pipeline = instance.template get_shader<Shader>();
+            style.init();
+        }
+
         for (size_t i = 0; i < children.size(); ++i) children[i]->render(instance, current_frame, cmd);
 
         cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline->pipeline.pipeline);
@@ -0,0 +1,319 @@
+#include "dom.h"
+
+#include <algorithm>
+
+namespace {
+    using namespace tau;
+
+    Quantity pixels(uint32_t v) {
+        return { .type = quantity_t::pixel, .value = static_cast<float>(v) };
+    }
+
+    // BlockLayout::layout without the children being placed
+    Box measureBlock(const BlockLayout& block, uint32_t width, uint32_t height, element& el) {
+        Box b{ .left = 0, .top = 0, .width = width, .height = height };
+
+        if (block.dimensions.x) b.width = block.dimensions.x->pixels_relative_to(width);
+        if (block.dimensions.y) {
+            b.height = block.dimensions.y->pixels_relative_to(width);
+            return b;
+        }
+
+        auto insetX = block.margin.x.value_or(0_px).pixels_relative_to(width) + block.padding.x.value_or(0_px).pixels_relative_to(b.width);
+        auto insetY = block.margin.y.value_or(0_px).pixels_relative_to(width) + block.padding.y.value_or(0_px).pixels_relative_to(b.width);
+
+        uint32_t sum = 0;
+        for (auto& c : el.children) sum += measureElement(*c, b.width - 2 * insetX, b.height - 2 * insetY).height;
+
+        b.height = sum + 2 * insetY;
+
+        return b;
+    }
+
+    struct Item {
+        element* el;
+        uint32_t basis;
+        uint32_t main;
+        uint32_t cross;
+        Align align;
+    };
+
+    struct Line {
+        size_t begin;
+        size_t end;
+        uint32_t main;
+        uint32_t cross;
+    };
+}
+
+tau::Layout tau::sizedLayout(const Layout& layout, uint32_t width, uint32_t height) {
+    auto fix = [&](auto l) {
+        if (width != unsized) l.dimensions.x = pixels(width);
+        if (height != unsized) l.dimensions.y = pixels(height);
+
+        return Layout(l);
+    };
+
+    if (auto block = std::get_if<BlockLayout>(&layout)) return fix(*block);
+    if (auto flex = std::get_if<FlexLayout>(&layout)) return fix(*flex);
+    if (auto grid = std::get_if<GridLayout>(&layout)) return fix(*grid);
+
+    return layout;
+}
+
+tau::Box tau::measureElement(element& el, uint32_t width, uint32_t height, uint32_t forceWidth, uint32_t forceHeight) {
+    // forcing the width a block or flex container would fill anyway changes nothing, so it
+    // shouldn't be a separate cache entry
+    if (forceWidth == width) {
+        if (auto block = std::get_if<BlockLayout>(&el.layout); block && !block->dimensions.x) forceWidth = unsized;
+        if (auto flex = std::get_if<FlexLayout>(&el.layout); flex && !flex->dimensions.x) forceWidth = unsized;
+        if (auto grid = std::get_if<GridLayout>(&el.layout); grid && !grid->dimensions.x) forceWidth = unsized;
+    }
+
+    // nothing reads the height it is given - heights come from content or resolve against the
+    // width - so it isn't part of the key
+    for (uint8_t i = 0; i < el.measureCount; ++i) {
+        auto& m = el.measures[i];
+
+        if (m.width == width && m.forceWidth == forceWidth && m.forceHeight == forceHeight) return m.size;
+    }
+
+    auto layout = sizedLayout(el.layout, forceWidth, forceHeight);
+
+    Box size;
+
+    if (auto block = std::get_if<BlockLayout>(&layout)) size = measureBlock(*block, width, height, el);
+    else if (auto flex = std::get_if<FlexLayout>(&layout)) size = flex->run({ .left = 0, .top = 0, .width = width, .height = height }, el, false);
+    else if (auto grid = std::get_if<GridLayout>(&layout)) size = grid->run({ .left = 0, .top = 0, .width = width, .height = height }, el, false);
+    else if (auto span = std::get_if<SpanLayout>(&layout)) size = span->layout({ .left = 0, .top = 0, .width = width, .height = height }, el);
+    else size = { .left = 0, .top = 0, .width = width, .height = 0 };
+
+    // a forced size wins over whatever the element made of it, the same as when it is placed
+    if (forceWidth != unsized) size.width = forceWidth;
+    if (forceHeight != unsized) size.height = forceHeight;
+
+    el.measures[el.measureNext] = { .width = width, .forceWidth = forceWidth, .forceHeight = forceHeight, .size = size };
+    el.measureNext = (el.measureNext + 1) % el.measures.size();
+    el.measureCount = std::min<uint8_t>(el.measureCount + 1, static_cast<uint8_t>(el.measures.size()));
+
+    return size;
+}
+
+tau::Box tau::FlexLayout::layout(Box available, element& el) const {
+    return run(available, el, true);
+}
+
+tau::Box tau::FlexLayout::run(Box available, element& el, bool place) const {
+    bool row = direction == FlexDirection::row;
+
+    auto mainOf = [&](const Box& b) { return row ? b.width : b.height; };
+    auto crossOf = [&](const Box& b) { return row ? b.height : b.width; };
+
+    Box b = available;
+
+    if (dimensions.x) b.width = dimensions.x->pixels_relative_to(available.width);
+    if (dimensions.y) b.height = dimensions.y->pixels_relative_to(available.width);
+
+    auto marginX = margin.x.value_or(0_px).pixels_relative_to(available.width);
+    auto marginY = margin.y.value_or(0_px).pixels_relative_to(available.width);
+    auto insetX = marginX + padding.x.value_or(0_px).pixels_relative_to(b.width);
+    auto insetY = marginY + padding.y.value_or(0_px).pixels_relative_to(b.width);
+
+    Box inner{
+        .left = b.left + insetX,
+        .top = b.top + insetY,
+        .width = b.width - 2 * insetX,
+        .height = b.height - 2 * insetY
+    };
+
+    // the width is always known, the height only when it was given
+    bool mainDefinite = row || dimensions.y.has_value();
+    bool crossDefinite = !row || dimensions.y.has_value();
+
+    auto innerMain = mainOf(inner);
+    auto innerCross = crossOf(inner);
+    auto spacing = gap ? gap->pixels_relative_to(inner.width) : 0;
+
+    // css-flexbox-1 9.2: hypothetical main sizes from the flex basis
+    std::vector<Item> items;
+    items.reserve(el.children.size());
+
+    for (auto& c : el.children) {
+        uint32_t basis;
+
+        // a percentage of an indefinite main size is as good as no basis at all
+        if (c->item.basis && (mainDefinite || c->item.basis->type == quantity_t::pixel)) basis = c->item.basis->pixels_relative_to(innerMain);
+        else basis = mainOf(measureElement(*c, inner.width, inner.height));
+
+        items.push_back({ .el = c.get(), .basis = basis, .main = basis, .cross = 0, .align = c->item.alignSelf.value_or(align) });
+    }
+
+    // 9.3: collect items into lines
+    std::vector<Line> lines;
+
+    for (size_t i = 0; i < items.size();) {
+        Line line{ .begin = i, .end = i, .main = 0, .cross = 0 };
+
+        for (; i < items.size(); ++i) {
+            auto next = line.main + (i > line.begin ? spacing : 0) + items[i].basis;
+
+            if (wrap && mainDefinite && i > line.begin && next > innerMain) break;
+
+            line.main = next;
+        }
+
+        line.end = i;
+        lines.push_back(line);
+    }
+
+    // 9.7: resolve the flexible lengths once per line, negative sizes are clamped rather than
+    // looped over so every item is measured a bounded number of times
+    for (auto& line : lines) {
+        int64_t free = mainDefinite ? static_cast<int64_t>(innerMain) - line.main : 0;
+
+        float grow = 0;
+        float shrink = 0;
+
+        for (auto i = line.begin; i < line.end; ++i) {
+            grow += items[i].el->item.grow;
+            shrink += items[i].el->item.shrink * items[i].basis;
+        }
+
+        line.main = 0;
+
+        for (auto i = line.begin; i < line.end; ++i) {
+            auto& it = items[i];
+            auto& item = it.el->item;
+
+            if (free > 0 && grow > 0) it.main = it.basis + static_cast<uint32_t>(free * (item.grow / grow));
+            else if (free < 0 && shrink > 0) it.main = static_cast<uint32_t>(std::max(0.0f, it.basis + free * (item.shrink * it.basis / shrink)));
+
+            // 9.4: the hypothetical cross size at the resolved main size
+            auto size = row ? measureElement(*it.el, it.main, inner.height, it.main, unsized) : measureElement(*it.el, inner.width, it.main, unsized, it.main);
+
+            it.cross = crossOf(size);
+
+            line.main += it.main + (i > line.begin ? spacing : 0);
+            line.cross = std::max(line.cross, it.cross);
+        }
+    }
+
+    // 9.4: a single line fills a definite container
+    if (lines.size() == 1 && crossDefinite) lines[0].cross = innerCross;
+
+    uint32_t usedMain = 0;
+    uint32_t usedCross = 0;
+
+    for (size_t l = 0; l < lines.size(); ++l) {
+        usedMain = std::max(usedMain, lines[l].main);
+        usedCross += lines[l].cross + (l > 0 ? spacing : 0);
+    }
+
+    if (row && !dimensions.y) b.height = usedCross + 2 * insetY;
+    if (!row && !dimensions.y) b.height = usedMain + 2 * insetY;
+
+    if (!place) return b;
+
+    el.content = b;
+    el.content.left += marginX;
+    el.content.width -= 2 * marginX;
+    el.content.top += marginY;
+    el.content.height -= 2 * marginY;
+
+    innerMain = row ? inner.width : b.height - 2 * insetY;
+
+    // 9.5 and 9.6: justify along the main axis, align along the cross axis
+    auto crossCursor = row ? inner.top : inner.left;
+
+    for (auto& line : lines) {
+        auto count = static_cast<uint32_t>(line.end - line.begin);
+        auto leftover = innerMain > line.main ? innerMain - line.main : 0;
+
+        uint32_t offset = 0;
+        uint32_t extra = 0;
+
+        switch (justify) {
+        case Justify::start:
+            break;
+        case Justify::end:
+            offset = leftover;
+            break;
+        case Justify::center:
+            offset = leftover / 2;
+            break;
+        case Justify::spaceBetween:
+            extra = count > 1 ? leftover / (count - 1) : 0;
+            break;
+        case Justify::spaceAround:
+            extra = leftover / count;
+            offset = extra / 2;
+            break;
+        case Justify::spaceEvenly:
+            extra = leftover / (count + 1);
+            offset = extra;
+            break;
+        }
+
+        auto mainCursor = (row ? inner.left : inner.top) + offset;
+
+        for (auto i = line.begin; i < line.end; ++i) {
+            auto& it = items[i];
+
+            uint32_t cross = it.cross;
+            uint32_t crossOffset = 0;
+            uint32_t forceCross = unsized;
+
+            switch (it.align) {
+            case Align::start:
+                break;
+            case Align::end:
+                crossOffset = line.cross > cross ? line.cross - cross : 0;
+                break;
+            case Align::center:
+                crossOffset = line.cross > cross ? (line.cross - cross) / 2 : 0;
+                break;
+            case Align::stretch: {
+                // only items without a cross size of their own are stretched
+                bool sized = false;
+
+                if (auto block = std::get_if<BlockLayout>(&it.el->layout)) sized = (row ? block->dimensions.y : block->dimensions.x).has_value();
+                else if (auto flex = std::get_if<FlexLayout>(&it.el->layout)) sized = (row ? flex->dimensions.y : flex->dimensions.x).has_value();
+                else if (auto grid = std::get_if<GridLayout>(&it.el->layout)) sized = (row ? grid->dimensions.y : grid->dimensions.x).has_value();
+
+                if (!sized) {
+                    cross = line.cross;
+                    forceCross = cross;
+                }
+
+                break;
+            }
+            }
+
+            Box slot = row
+                ? Box{ .left = mainCursor, .top = crossCursor + crossOffset, .width = it.main, .height = cross }
+                : Box{ .left = crossCursor + crossOffset, .top = mainCursor, .width = cross, .height = it.main };
+
+            // laid out against the same box it was measured in, just moved into place
+            Box av = slot;
+
+            if (row) av.height = inner.height;
+            else av.width = inner.width;
+
+            auto layout = row ? sizedLayout(it.el->layout, it.main, forceCross) : sizedLayout(it.el->layout, forceCross, it.main);
+
+            it.el->bounds = layoutWith(layout, av, *it.el);
+
+            // kinds that can't be sized just get the slot
+            if (std::holds_alternative<std::monostate>(layout) || std::holds_alternative<SpanLayout>(layout)) it.el->bounds = slot;
+
+            it.el->layoutDirty = false;
+            it.el->childDirty = false;
+
+            mainCursor += it.main + spacing + extra;
+        }
+
+        crossCursor += line.cross + spacing;
+    }
+
+    return b;
+}
@@ -0,0 +1,308 @@
+#include "dom.h"
+
+#include <algorithm>
+
+namespace {
+    using namespace tau;
+
+    // sizes `tracks` into `offsets`, fractions share whatever `space` the rest leaves; `content`
+    // stands in for tracks that fit their cells, or for fractions when there is no space to share
+    void sizeTracks(std::span<const Quantity> tracks, size_t count, uint32_t reference, std::optional<uint32_t> space, uint32_t spacing, std::span<const uint32_t> content, std::vector<uint32_t>& offsets) {
+        uint32_t fixed = 0;
+        float fractions = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i >= tracks.size()) fixed += content[i];
+            else if (tracks[i].type != quantity_t::fraction) fixed += tracks[i].pixels_relative_to(reference);
+            else if (space) fractions += tracks[i].value;
+            else fixed += content[i];
+        }
+
+        auto gaps = count > 1 ? static_cast<uint32_t>(count - 1) * spacing : 0;
+        auto leftover = space && *space > fixed + gaps ? *space - fixed - gaps : 0;
+
+        offsets.resize(count + 1);
+        offsets[0] = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t size;
+
+            if (i >= tracks.size()) size = content[i];
+            else if (tracks[i].type != quantity_t::fraction) size = tracks[i].pixels_relative_to(reference);
+            else if (space) size = static_cast<uint32_t>(leftover * (tracks[i].value / fractions));
+            else size = content[i];
+
+            offsets[i + 1] = offsets[i] + size + spacing;
+        }
+    }
+
+    uint32_t span(const std::vector<uint32_t>& offsets, uint32_t first, uint32_t count, uint32_t spacing) {
+        return offsets[first + count] - offsets[first] - spacing;
+    }
+
+    // which cells placement has handed out so far, grown a row at a time; rows past the end are free
+    struct Occupancy {
+        uint32_t columns;
+        std::vector<uint8_t> used;
+
+        bool free(uint32_t row, uint32_t column, uint32_t rowSpan, uint32_t columnSpan) const {
+            for (auto r = row; r < row + rowSpan && size_t(r) * columns < used.size(); ++r) {
+                for (auto k = column; k < column + columnSpan; ++k) {
+                    if (used[size_t(r) * columns + k]) return false;
+                }
+            }
+
+            return true;
+        }
+
+        void take(const GridCache::Cell& cell) {
+            auto end = size_t(cell.row + cell.rowSpan) * columns;
+            if (used.size() < end) used.resize(end, 0);
+
+            for (auto r = cell.row; r < cell.row + cell.rowSpan; ++r) {
+                for (auto k = cell.column; k < cell.column + cell.columnSpan; ++k) used[size_t(r) * columns + k] = 1;
+            }
+        }
+    };
+}
+
+tau::Box tau::GridLayout::layout(Box available, element& el) const {
+    return run(available, el, true);
+}
+
+tau::Box tau::GridLayout::run(Box available, element& el, bool place) const {
+    if (!el.gridCache) el.gridCache = std::make_unique<GridCache>();
+
+    auto& c = *el.gridCache;
+
+    Box b = available;
+
+    if (dimensions.x) b.width = dimensions.x->pixels_relative_to(available.width);
+    if (dimensions.y) b.height = dimensions.y->pixels_relative_to(available.width);
+
+    auto marginX = margin.x.value_or(0_px).pixels_relative_to(available.width);
+    auto marginY = margin.y.value_or(0_px).pixels_relative_to(available.width);
+    auto insetX = marginX + padding.x.value_or(0_px).pixels_relative_to(b.width);
+    auto insetY = marginY + padding.y.value_or(0_px).pixels_relative_to(b.width);
+
+    Box inner{
+        .left = b.left + insetX,
+        .top = b.top + insetY,
+        .width = b.width - 2 * insetX,
+        .height = b.height - 2 * insetY
+    };
+
+    auto spacing = gap ? gap->pixels_relative_to(inner.width) : 0;
+
+    // no columns is one column across the whole grid
+    static const Quantity whole[] = { 1_fr };
+    std::span<const Quantity> columnTracks = columns.empty() ? std::span<const Quantity>(whole) : std::span<const Quantity>(columns);
+    auto columnCount = static_cast<uint32_t>(columnTracks.size());
+
+    // columns only depend on the width, their tracks and the gap
+    bool resized = c.width != inner.width || c.spacing != spacing || !std::ranges::equal(c.columns, columnTracks);
+
+    if (resized) {
+        std::vector<uint32_t> none(columnCount, 0);
+        sizeTracks(columnTracks, columnCount, inner.width, inner.width, spacing, none, c.columnOffsets);
+
+        c.width = inner.width;
+        c.spacing = spacing;
+        c.columns.assign(columnTracks.begin(), columnTracks.end());
+    }
+
+    // placement, and which rows have to be measured again
+    auto& children = el.children;
+    auto previous = c.cells.size();
+
+    std::vector<uint8_t> stale(c.rowContent.size(), resized);
+
+    auto markRows = [&](const GridCache::Cell& cell) {
+        if (stale.size() < cell.row + cell.rowSpan) stale.resize(cell.row + cell.rowSpan, 1);
+
+        for (auto r = cell.row; r < cell.row + cell.rowSpan; ++r) stale[r] = 1;
+    };
+
+    // removed cells leave their rows behind
+    for (auto i = children.size(); i < previous; ++i) markRows(c.cells[i]);
+
+    c.cells.resize(children.size());
+    c.owners.resize(children.size(), nullptr);
+
+    std::vector<GridCache::Cell> placed(children.size());
+    Occupancy occupancy{ .columns = columnCount };
+
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto& item = children[i]->cell;
+
+        placed[i] = {
+            .rowSpan = std::max<uint32_t>(item.rowSpan, 1),
+            .columnSpan = std::clamp<uint32_t>(item.columnSpan, 1, columnCount)
+        };
+    }
+
+    // cells locked to a row first; one that fits nowhere in it ends up over the last columns
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto& item = children[i]->cell;
+        auto& cell = placed[i];
+
+        if (!item.row) continue;
+
+        cell.row = *item.row;
+
+        if (item.column) {
+            cell.column = std::min<uint32_t>(*item.column, columnCount - cell.columnSpan);
+        } else {
+            cell.column = 0;
+
+            while (cell.column + cell.columnSpan < columnCount && !occupancy.free(cell.row, cell.column, cell.rowSpan, cell.columnSpan)) ++cell.column;
+        }
+
+        occupancy.take(cell);
+    }
+
+    uint32_t cursorRow = 0;
+    uint32_t cursorColumn = 0;
+
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto& item = children[i]->cell;
+        auto& cell = placed[i];
+
+        if (item.row) continue;
+
+        if (item.column) {
+            cell.column = std::min<uint32_t>(*item.column, columnCount - cell.columnSpan);
+
+            if (cell.column < cursorColumn) ++cursorRow;
+
+            while (!occupancy.free(cursorRow, cell.column, cell.rowSpan, cell.columnSpan)) ++cursorRow;
+        } else {
+            cell.column = cursorColumn;
+
+            for (;;) {
+                if (cell.column + cell.columnSpan > columnCount) {
+                    ++cursorRow;
+                    cell.column = 0;
+                }
+
+                if (occupancy.free(cursorRow, cell.column, cell.rowSpan, cell.columnSpan)) break;
+
+                ++cell.column;
+            }
+        }
+
+        cell.row = cursorRow;
+        cursorColumn = cell.column + cell.columnSpan;
+
+        occupancy.take(cell);
+    }
+
+    uint32_t rowCount = 0;
+
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto& cell = placed[i];
+
+        rowCount = std::max(rowCount, cell.row + cell.rowSpan);
+
+        // a reordered child list puts other elements into the same cells
+        bool replaced = i >= previous || c.owners[i] != children[i].get();
+        bool moved = replaced || c.cells[i] != cell;
+        bool dirty = children[i]->layoutDirty || children[i]->childDirty;
+
+        if (moved && i < previous) markRows(c.cells[i]);
+        if (moved || dirty) markRows(cell);
+
+        c.cells[i] = cell;
+        c.owners[i] = children[i].get();
+    }
+
+    stale.resize(rowCount, 1);
+    c.rowContent.resize(rowCount, 0);
+
+    // counting sort of cells by the row they start in, then the tallest single-row cell of each
+    // stale row; everything else keeps its measurement from last time
+    std::vector<uint32_t> rowStart(rowCount + 1, 0);
+
+    for (auto& cell : c.cells) ++rowStart[cell.row + 1];
+    for (uint32_t r = 0; r < rowCount; ++r) rowStart[r + 1] += rowStart[r];
+
+    std::vector<uint32_t> byRow(c.cells.size());
+    {
+        auto next = rowStart;
+        for (uint32_t i = 0; i < c.cells.size(); ++i) byRow[next[c.cells[i].row]++] = i;
+    }
+
+    for (uint32_t r = 0; r < rowCount; ++r) {
+        if (!stale[r]) continue;
+
+        uint32_t tallest = 0;
+
+        for (auto k = rowStart[r]; k < rowStart[r + 1]; ++k) {
+            auto& cell = c.cells[byRow[k]];
+
+            if (cell.rowSpan != 1) continue;
+
+            auto width = span(c.columnOffsets, cell.column, cell.columnSpan, spacing);
+            tallest = std::max(tallest, measureElement(*children[byRow[k]], width, 0, width).height);
+        }
+
+        c.rowContent[r] = tallest;
+    }
+
+    std::optional<uint32_t> height;
+    if (dimensions.y) height = inner.height;
+
+    sizeTracks(rows, rowCount, inner.width, height, spacing, c.rowContent, c.rowOffsets);
+
+    if (!dimensions.y) b.height = (rowCount > 0 ? c.rowOffsets[rowCount] - spacing : 0) + 2 * insetY;
+
+    if (!place) return b;
+
+    el.content = b;
+    el.content.left += marginX;
+    el.content.width -= 2 * marginX;
+    el.content.top += marginY;
+    el.content.height -= 2 * marginY;
+
+    // every cell fills its area
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto& cell = c.cells[i];
+        auto& child = *children[i];
+
+        Box area{
+            .left = inner.left + c.columnOffsets[cell.column],
+            .top = inner.top + c.rowOffsets[cell.row],
+            .width = span(c.columnOffsets, cell.column, cell.columnSpan, spacing),
+            .height = span(c.rowOffsets, cell.row, cell.rowSpan, spacing)
+        };
+
+        // a cell's bounds are always exactly its area, so a clean one that gets an area of the
+        // same size again would lay out the same and at most has to move
+        if (!child.layoutDirty && !child.childDirty && area.width == child.bounds.width && area.height == child.bounds.height) {
+            auto dx = area.left - child.bounds.left;
+            auto dy = area.top - child.bounds.top;
+
+            if (dx != 0 || dy != 0) {
+                child.bounds.left += dx;
+                child.bounds.top += dy;
+                child.content.left += dx;
+                child.content.top += dy;
+
+                shiftChildren(child, dx, dy);
+            }
+
+            continue;
+        }
+
+        auto layout = sizedLayout(child.layout, area.width, area.height);
+
+        child.bounds = layoutWith(layout, area, child);
+
+        if (std::holds_alternative<std::monostate>(layout) || std::holds_alternative<SpanLayout>(layout)) child.bounds = area;
+
+        child.layoutDirty = false;
+        child.childDirty = false;
+    }
+
+    return b;
+}
@@ -6,6 +6,8 @@
 #include <optional>
 #include <span>
 #include <limits>
+#include <algorithm>
+#include <bit>
 
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
@@ -36,71 +38,104 @@ void tau::Instance::loop() {
     }
 }
 
-void tau::Instance::render(std::unique_ptr<ComponentElement>&& comp) {
-    comp->child = comp->render_func();
-    comp->child->bounds = comp->child->layout->layout({
-        .left = 0,
-        .top = 0,
-        .width = swapchain.extent.width,
-        .height = swapchain.extent.height
-    }, *comp->child);
-
+void tau::Instance::render(ptr<ComponentElement>&& comp) {
+    build(*comp);
     top_component = std::move(comp);
+    relayout();
 
     loop();
 }
 
-static void frameBufferResizeCallback(GLFWwindow* window, int width, int height) {
-    auto app = reinterpret_cast<tau::Instance*>(glfwGetWindowUserPointer(window));
-    app->framebufferResized = true;
+void tau::Instance::rebuild() {
+    treeStale = true;
 }
 
-uint32_t findMemoryType(const vk::raii::PhysicalDevice& pd, uint32_t typeFilter, vk::MemoryPropertyFlagBits properties) {
-    vk::PhysicalDeviceMemoryProperties memProperties = pd.getMemoryProperties();
+void tau::Instance::build(ComponentElement& comp) {
+    // the previous generation has to be torn down before its memory goes
+    comp.child.reset();
 
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
-    }
+    treeArena = std::make_unique<Arena>();
+
+    Arena::Scope scope(*treeArena);
+    comp.child = comp.render_func();
+
+    // big subtrees are laid out on the decode workers, the frame thread helps while it waits
+    layoutTree.pool = &workers;
+    layoutTree.build(*comp.child);
+}
 
-    throw std::runtime_error("failed to find suitable memory type!");
+void tau::Instance::relayout() {
+    layoutTree.layout({
+        .left = 0,
+        .top = 0,
+        .width = swapchain.extent.width,
+        .height = swapchain.extent.height
+    });
 }
 
-std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> tau::Instance::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties) {
+static void frameBufferResizeCallback(GLFWwindow* window, int width, int height) {
+    auto app = reinterpret_cast<tau::Instance*>(glfwGetWindowUserPointer(window));
+    app->framebufferResized = true;
+}
+
+std::pair<vk::raii::Buffer, tau::Allocation> tau::Instance::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryPool pool) {
     vk::BufferCreateInfo bufferInfo{};
     bufferInfo.size = size;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = vk::SharingMode::eExclusive;
 
-    auto buffer = device.createBuffer(bufferInfo);
+    // staging memory is copied from on both queues (atlas patches go through the graphics side)
+    uint32_t families[] = { graphicsFamily, transferFamily };
 
-    auto memRequirements = buffer.getMemoryRequirements();
+    if (pool == MemoryPool::staging && graphicsFamily != transferFamily) {
+        bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = families;
+    }
 
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, *(vk::MemoryPropertyFlagBits*)&properties); // fuck it
+    auto buffer = device.createBuffer(bufferInfo);
 
-    auto memory = device.allocateMemory(allocInfo);
+    auto memory = allocator.allocate(buffer.getMemoryRequirements(), properties, pool, true);
 
-    buffer.bindMemory(*memory, 0);
+    buffer.bindMemory(memory.memory, memory.offset);
 
     return std::make_pair(std::move(buffer), std::move(memory));
 }
 
 void tau::Instance::frame() {
     device.waitForFences({ *inFlightFences[currentFrame] }, true, std::numeric_limits<uint64_t>::max());
+    ++frameNumber;
+    runDeferred();
+    retireUploads();
+    finishDecodes();
+    trimImages();
+
+    // however many resize events came in since the last frame, the swapchain is rebuilt at most
+    // once for them, and the layout below is the only one done at the new size
+    if (framebufferResized || swapchainStale) {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+
+        // a drag that ended where it started changes nothing
+        if (swapchainStale || static_cast<uint32_t>(width) != swapchain.extent.width || static_cast<uint32_t>(height) != swapchain.extent.height) swapchain.recreate(*this);
+
+        framebufferResized = false;
+        swapchainStale = false;
+    }
+
+    // a new generation is laid out from scratch below
+    if (treeStale && top_component) {
+        build(*top_component);
+        treeStale = false;
+    }
+
+    // only whatever was invalidated since the last frame is laid out again
+    relayout();
 
     auto[res, i] = swapchain.swapchain.acquireNextImage(std::numeric_limits<uint64_t>::max(), *imageAvailableSemaphores[currentFrame]);
 
     if (res == vk::Result::eErrorOutOfDateKHR) {
-        swapchain.recreate(*this);
-        top_component->child->bounds = top_component->child->layout->layout({
-            .left = 0,
-            .top = 0,
-            .width = swapchain.extent.width,
-            .height = swapchain.extent.height
-        }, *top_component->child);
+        swapchainStale = true;
         return;
     } else if (res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR) {
         throw std::runtime_error("failed to present swap chain image!");
@@ -111,6 +146,12 @@ void tau::Instance::frame() {
     commandBuffers[currentFrame].reset();
     recordCommandBuffer(commandBuffers[currentFrame], currentFrame, i);
 
+    // glyphs first drawn this frame, before the batch they are copied in goes out
+    flushGlyphs();
+
+    // anything recorded while building or drawing the tree goes out ahead of the frame that uses it
+    flushUploads();
+
     vk::SubmitInfo submitInfo{};
 
     vk::Semaphore waitSemaphores[] = { *imageAvailableSemaphores[currentFrame] };
@@ -128,6 +169,7 @@ void tau::Instance::frame() {
 
     // submit that fucker
     graphicsQueue.submit({ submitInfo }, *inFlightFences[currentFrame]);
+    slotSubmitted[currentFrame] = ++framesSubmitted;
 
     vk::PresentInfoKHR pi{};
     pi.waitSemaphoreCount = 1;
@@ -140,15 +182,8 @@ void tau::Instance::frame() {
 
     res = presentQueue.presentKHR(pi);
 
-    if (res == vk::Result::eErrorOutOfDateKHR || res == vk::Result::eSuboptimalKHR || framebufferResized) {
-        framebufferResized = false;
-        swapchain.recreate(*this);
-        top_component->child->bounds = top_component->child->layout->layout({
-            .left = 0,
-            .top = 0,
-            .width = swapchain.extent.width,
-            .height = swapchain.extent.height
-        }, *top_component->child);
+    if (res == vk::Result::eErrorOutOfDateKHR || res == vk::Result::eSuboptimalKHR) {
+        swapchainStale = true;
     } else if (res != vk::Result::eSuccess) {
         throw std::runtime_error("failed to present swap chain image!");
     }
@@ -206,6 +241,9 @@ void tau::Instance::recordCommandBuffer(vk::raii::CommandBuffer& cmd, int frame,
 
     // cmd.draw(6, 1, 0, 0);
 
+    // components build their child on first render, that belongs to the current generation too
+    Arena::Scope scope(*treeArena);
+
     top_component->render(*this, frame, cmd);
 
     cmd.endRenderPass();
@@ -241,6 +279,7 @@ SwapChainSupportDetails querySwapChainSupport(vk::raii::PhysicalDevice& device,
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> transferFamily;
 
     bool complete() const { return graphicsFamily.has_value() && presentFamily.has_value(); }
 };
@@ -267,6 +306,16 @@ QueueFamilyIndices queueFamilies(vk::raii::PhysicalDevice& device, vk::raii::Sur
         i++;
     }
 
+    // a family that can copy but not draw maps to the dedicated DMA engine on discrete GPUs,
+    // one without compute as well is the purest match
+    for (uint32_t j = 0; j < queueFamilies.size(); ++j) {
+        auto flags = queueFamilies[j].queueFlags;
+
+        if (!(flags & vk::QueueFlagBits::eTransfer) || (flags & vk::QueueFlagBits::eGraphics)) continue;
+
+        if (!indices.transferFamily.has_value() || !(flags & vk::QueueFlagBits::eCompute)) indices.transferFamily = j;
+    }
+
     return indices;
 }
 
@@ -320,19 +369,29 @@ vk::raii::PhysicalDevice tau::Instance::createPhysicalDevice() {
 vk::raii::Device tau::Instance::createDevice() {
     QueueFamilyIndices indices = queueFamilies(physicalDevice, surface);
 
+    float queuePriority = 1.0f;
+
+    std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
+
     vk::DeviceQueueCreateInfo queueCreateInfo{};
     queueCreateInfo.queueFamilyIndex = indices.graphicsFamily.value();
     queueCreateInfo.queueCount = 1;
-
-    float queuePriority = 1.0f;
     queueCreateInfo.pQueuePriorities = &queuePriority;
 
+    queueCreateInfos.push_back(queueCreateInfo);
+
+    if (indices.transferFamily.has_value()) {
+        queueCreateInfo.queueFamilyIndex = indices.transferFamily.value();
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
     vk::PhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = true;
+    deviceFeatures.textureCompressionBC = physicalDevice.getFeatures().textureCompressionBC;
 
     vk::DeviceCreateInfo createInfo{};
-    createInfo.pQueueCreateInfos = &queueCreateInfo;
-    createInfo.queueCreateInfoCount = 1;
+    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
@@ -394,7 +453,7 @@ vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities, GL
     }
 }
 
-tau::Swapchain tau::Instance::createSwapchain() {
+tau::Swapchain tau::Instance::createSwapchain(vk::SwapchainKHR old) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, surface);
 
     vk::SurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -436,7 +495,7 @@ tau::Swapchain tau::Instance::createSwapchain() {
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
 
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = old;
 
     Swapchain swapchain;
 
@@ -454,10 +513,10 @@ tau::Swapchain tau::Instance::createSwapchain() {
     return swapchain;
 }
 
-vk::raii::CommandPool tau::Instance::createCommandPool() {
+vk::raii::CommandPool tau::Instance::createCommandPool(uint32_t family) {
     vk::CommandPoolCreateInfo cpci{};
     cpci.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
-    cpci.queueFamilyIndex = queueFamilies(physicalDevice, surface).graphicsFamily.value();
+    cpci.queueFamilyIndex = family;
 
     return vk::raii::CommandPool(device, cpci);
 }
@@ -558,14 +617,14 @@ vk::raii::RenderPass tau::Instance::createRenderPass() {
     return vk::raii::RenderPass(device, createInfo);
 }
 
-vk::raii::ImageView tau::Instance::createImageView(VkImage image, vk::Format format, vk::ImageAspectFlagBits aspectFlags) {
+vk::raii::ImageView tau::Instance::createImageView(VkImage image, vk::Format format, vk::ImageAspectFlagBits aspectFlags, uint32_t mipLevels) {
     vk::ImageViewCreateInfo viewInfo{};
     viewInfo.image = image;
     viewInfo.viewType = vk::ImageViewType::e2D;
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
@@ -573,8 +632,12 @@ vk::raii::ImageView tau::Instance::createImageView(VkImage image, vk::Format for
 }
 
 vk::raii::CommandBuffer tau::Instance::beginSingleCommand() {
+    return beginSingleCommand(commandPool);
+}
+
+vk::raii::CommandBuffer tau::Instance::beginSingleCommand(const vk::raii::CommandPool& pool) {
     vk::CommandBufferAllocateInfo allocInfo{};
-    allocInfo.commandPool = *commandPool;
+    allocInfo.commandPool = *pool;
     allocInfo.commandBufferCount = 1;
 
     vk::raii::CommandBuffer commandBuffer = std::move(device.allocateCommandBuffers(allocInfo)[0]);
@@ -587,187 +650,169 @@ vk::raii::CommandBuffer tau::Instance::beginSingleCommand() {
     return commandBuffer;
 }
 
-bool hasStencilComponent(vk::Format format) {
-    return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
-}
-
-void tau::Instance::transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout) {
-    auto cmd = beginSingleCommand();
+/* void tau::Instance::draw(element<Gradient> &e, vk::raii::CommandBuffer& cmd) {
+    // cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *Gradient::state.playout, 0, {});
+    // cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *Gradient::state.pipeline);
+} */
 
-    vk::ImageMemoryBarrier barrier{};
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
+vk::Sampler tau::Instance::getSampler(const SamplerKey& key) {
+    if (auto it = sampler_cache.find(key); it != sampler_cache.end()) return *it->second;
 
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vk::SamplerCreateInfo sci{};
+    sci.addressModeU = key.address;
+    sci.addressModeV = key.address;
+    sci.addressModeW = key.address;
+    sci.anisotropyEnable = false;
+    sci.minFilter = key.filter;
+    sci.magFilter = key.filter;
+    sci.unnormalizedCoordinates = false;
+    sci.compareEnable = false;
+    sci.compareOp = vk::CompareOp::eAlways;
+    sci.mipmapMode = key.mipmap;
+    sci.mipLodBias = 0.0f;
+    sci.minLod = 0.0f;
+    sci.maxLod = key.maxLod;
+    sci.borderColor = vk::BorderColor::eIntOpaqueBlack;
 
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
+    return *sampler_cache.emplace(key, device.createSampler(sci)).first->second;
+}
 
-    vk::PipelineStageFlagBits sourceStage;
-    vk::PipelineStageFlagBits destinationStage;
+tau::CombinedImage* tau::Instance::getImage(std::string& img, ivec2 resolution) {
+    // the same file shown at two sizes is two textures
+    auto key = img;
+    if (resolution.x > 0 || resolution.y > 0) key += "@" + std::to_string(resolution.x) + "x" + std::to_string(resolution.y);
 
-    if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
-        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+    if (auto it = image_cache.find(key); it != image_cache.end()) {
+        ++imageStats.hits;
+        it->second.lastUsed = framesSubmitted;
 
-        if (hasStencilComponent(format)) {
-            barrier.subresourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
-        }
-    } else {
-        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+        return &it->second;
     }
 
-    if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal) {
-        barrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+    ++imageStats.misses;
 
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eTransfer;
-    } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+    // drawn as a placeholder until a worker has decoded it and the upload has landed
+    tau::CombinedImage image;
+    image.img.upload = Image::pending;
 
-        sourceStage = vk::PipelineStageFlagBits::eTransfer;
-        destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-    } else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
-        barrier.srcAccessMask = vk::AccessFlagBits::eNone;
-        barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    image_cache[key] = std::move(image);
 
-        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-        destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
+    workers.submit([this, path = img, key, resolution] {
+        auto image = decodeImage(path, staging, std::max(resolution.x, 0), std::max(resolution.y, 0), compressedFormats);
+        image.key = key;
 
-    cmd.pipelineBarrier(sourceStage, destinationStage, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+        std::lock_guard lock(decodeMutex);
+        decoded.push_back(std::move(image));
+    });
 
-    cmd.end();
+    return &image_cache[key];
+}
 
-    vk::CommandBuffer cb = *cmd;
+void tau::Instance::finishDecodes() {
+    std::vector<DecodedImage> ready;
 
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cb;
-    
-    graphicsQueue.submit({ submitInfo });
-    graphicsQueue.waitIdle();
-}
+    {
+        std::lock_guard lock(decodeMutex);
+        ready.swap(decoded);
+    }
 
-/* void tau::Instance::draw(element<Gradient> &e, vk::raii::CommandBuffer& cmd) {
-    // cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *Gradient::state.playout, 0, {});
-    // cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *Gradient::state.pipeline);
-} */
+    for (auto& image : ready) {
+        auto it = image_cache.find(image.key);
 
-tau::CombinedImage* tau::Instance::getImage(std::string& img) {
-    if (image_cache.contains(img)) return &image_cache.at(img);
+        if (it == image_cache.end() || !image.valid()) {
+            if (!image.valid()) std::cerr << "failed to load image " << image.key << '\n';
 
-    tau::CombinedImage image;
-    image.img = loadColorTexture(img.c_str());
+            // nothing is going to copy out of it, hand the reservation straight back
+            if (image.staged) staging.commit(*image.staged, 0);
+            continue;
+        }
 
-    vk::SamplerCreateInfo sci{};
-    sci.addressModeU = vk::SamplerAddressMode::eClampToEdge;
-    sci.addressModeV = vk::SamplerAddressMode::eClampToEdge;
-    sci.addressModeW = vk::SamplerAddressMode::eClampToEdge;
-    sci.anisotropyEnable = false;
-    sci.minFilter = vk::Filter::eNearest;
-    sci.magFilter = vk::Filter::eNearest;
-    sci.unnormalizedCoordinates = false;
-    sci.compareEnable = false;
-    sci.compareOp = vk::CompareOp::eAlways;
-    sci.mipmapMode = vk::SamplerMipmapMode::eNearest;
-    sci.mipLodBias = 0.0f;
-    sci.minLod = 0.0f;
-    sci.maxLod = 0.0f;
-    sci.borderColor = vk::BorderColor::eIntOpaqueBlack;
+        auto& entry = it->second;
 
-    image.sampler = device.createSampler(sci);
+        // filled some other way in the meantime
+        if (entry.img.upload != Image::pending) {
+            if (image.staged) staging.commit(*image.staged, 0);
+            continue;
+        }
 
-    image_cache[img] = std::move(image);
+        if (packIntoAtlas(entry, image)) continue;
 
-    return &image_cache[img];
+        entry.img = loadColorTexture(image);
+        entry.bytes = entry.img.memory.size;
+        imageStats.bytes += entry.bytes;
+    }
 }
 
-tau::Font* tau::Instance::getFont(std::string& font) {
-    if (font_cache.contains(font)) return &font_cache[font];
+void tau::Instance::trimImages() {
+    while (imageStats.bytes > imageBudget) {
+        auto victim = image_cache.end();
 
-    tau::Font fo;
+        // only whole textures free anything, atlas slots and pending decodes have nothing to give back
+        for (auto it = image_cache.begin(); it != image_cache.end(); ++it) {
+            auto& entry = it->second;
 
-    std::ifstream file(font, std::ios::ate | std::ios::binary);
-    auto size = file.tellg();
-    fo.buffer.resize(size);
-    file.seekg(0);
-    file.read(fo.buffer.data(), size);
+            if (entry.refs > 0 || entry.bytes == 0 || !uploaded(entry.img.upload)) continue;
+            if (victim != image_cache.end() && victim->second.lastUsed <= entry.lastUsed) continue;
 
-    stbtt_InitFont(&fo.info, (unsigned char*)fo.buffer.data(), 0);
+            victim = it;
+        }
 
-    fo.scale = stbtt_ScaleForPixelHeight(&fo.info, 64.0f);
+        if (victim == image_cache.end()) return;
 
-    for (size_t i = 0; i < fo.chars.size(); ++i) {
-        auto& fc = fo.chars[i];
-        int x;
-        int y;
-        int w;
-        int h;
+        imageStats.bytes -= victim->second.bytes;
+        ++imageStats.evictions;
 
-        fc.data = stbtt_GetCodepointSDF(&fo.info, fo.scale, i, 3, 128, 64.0f, &w, &h, &x, &y);
-        fc.x = x;
-        fc.y = y;
-        fc.w = w;
-        fc.h = h;
+        // frames still in flight may have it bound, it goes once every one of them has retired
+        defer([image = std::move(victim->second)] {});
 
-        int advance;
-        stbtt_GetCodepointHMetrics(&fo.info, i, &advance, nullptr);
-        fc.advance = advance * fo.scale;
+        image_cache.erase(victim);
     }
+}
 
-    auto& ch = fo.chars['a'];
+void tau::Instance::defer(std::move_only_function<void()> fn) {
+    deferred.emplace_back(framesSubmitted, std::move(fn));
+}
 
-    auto image = createImage(ch.w, ch.h, vk::Format::eR8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+void tau::Instance::runDeferred() {
+    while (!deferred.empty() && retired(deferred.front().first)) {
+        deferred.front().second();
+        deferred.pop_front();
+    }
+}
 
-    transitionImageLayout(*image.image, vk::Format::eR8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+bool tau::Instance::retired(uint64_t serial) const {
+    // a slot that has been submitted to since was waited on before that, frames that returned
+    // early never submitted and don't count
+    for (size_t k = 0; k < max_frames_in_flight; ++k) {
+        if (slotSubmitted[k] > serial) continue;
+        if (inFlightFences[k].getStatus() != vk::Result::eSuccess) return false;
+    }
 
-    vk::DeviceSize imageSize = ch.w * ch.h;
+    return true;
+}
 
-    auto[buffer, mem] = createBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto mapped = mem.mapMemory(0, imageSize);
-    std::memcpy(mapped, ch.data, imageSize);
-    mem.unmapMemory();
+tau::Font* tau::Instance::getFont(std::string& font) {
+    if (font_cache.contains(font)) return &font_cache[font];
 
-    auto cmd = beginSingleCommand();
+    // built in place, the glyph lock can't move
+    auto& fo = font_cache[font];
 
-    vk::BufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = vk::Offset3D{0, 0, 0};
-    region.imageExtent = vk::Extent3D{static_cast<uint32_t>(ch.w), static_cast<uint32_t>(ch.w), 1};
+    std::ifstream file(font, std::ios::ate | std::ios::binary);
+    auto size = file.tellg();
+    fo.buffer.resize(size);
+    file.seekg(0);
+    file.read(fo.buffer.data(), size);
 
-    cmd.copyBufferToImage(*buffer, *image.image, vk::ImageLayout::eTransferDstOptimal, { region });
-    
-    cmd.end();
-    
-    vk::CommandBuffer cb = *cmd;
-    
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cb;
-    
-    graphicsQueue.submit({ submitInfo });
-    graphicsQueue.waitIdle();
+    stbtt_InitFont(&fo.info, (unsigned char*)fo.buffer.data(), 0);
 
-    transitionImageLayout(*image.image, vk::Format::eR8Unorm, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+    fo.scale = stbtt_ScaleForPixelHeight(&fo.info, 64.0f);
 
-    image_cache["res/tau.png"].img = std::move(image);
+    int ascent;
+    stbtt_GetFontVMetrics(&fo.info, &ascent, nullptr, nullptr);
 
-    return &(font_cache[font] = std::move(fo));
+    fo.ascent = ascent * fo.scale;
+
+    return &fo;
 }
 
 tau::Instance::Instance() {
@@ -817,18 +862,38 @@ tau::Instance::Instance() {
     surface = createSurface();
     physicalDevice = createPhysicalDevice();
     device = createDevice();
+    allocator.init(device, physicalDevice);
+
+    auto rgbaFeatures = physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Unorm).optimalTilingFeatures;
+    // block formats images may keep on the gpu, everything else is expanded to RGBA8 while decoding
+    if (physicalDevice.getFeatures().textureCompressionBC) {
+        for (auto format : { vk::Format::eBc1RgbUnormBlock, vk::Format::eBc1RgbaUnormBlock, vk::Format::eBc3UnormBlock, vk::Format::eBc7UnormBlock }) {
+            auto features = physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+
+            if ((features & vk::FormatFeatureFlagBits::eSampledImage) && (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) compressedFormats.push_back(format);
+        }
+    }
+
+    linearBlit = (rgbaFeatures & (vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) == (vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst | vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
 
     auto indices = queueFamilies(physicalDevice, surface);
 
-    graphicsQueue = device.getQueue(indices.graphicsFamily.value(), 0);
+    graphicsFamily = indices.graphicsFamily.value();
+    transferFamily = indices.transferFamily.value_or(graphicsFamily);
+
+    graphicsQueue = device.getQueue(graphicsFamily, 0);
     presentQueue = device.getQueue(indices.presentFamily.value(), 0);
+    transferQueue = device.getQueue(transferFamily, 0);
 
     swapchain = createSwapchain();
-    commandPool = createCommandPool();
+    commandPool = createCommandPool(graphicsFamily);
+    transferPool = createCommandPool(transferFamily);
     commandBuffers = createCommandBuffers();
     renderPass = createRenderPass();
     depthTexture = createDepthTexture();
     createFramebuffersForSwapchain(swapchain);
+    staging.init(*this, StagingRing::default_capacity);
+    placeholder = createPlaceholder();
 
     vk::SemaphoreCreateInfo sci{};
 
@@ -844,16 +909,22 @@ tau::Instance::Instance() {
 }
 
 tau::Instance::~Instance() {
+    // upload batches, staging memory, retired swapchains and evicted images may all still be in use
+    // by submitted work, none of it can go before the device is done
+    device.waitIdle();
+
+    for (; !deferred.empty(); deferred.pop_front()) deferred.front().second();
+
     glfwDestroyWindow(window);
 }
 
-tau::Image tau::Instance::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits properties, vk::ImageAspectFlagBits aspect) {
+tau::Image tau::Instance::createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlagBits aspect, uint32_t mipLevels) {
     vk::ImageCreateInfo imageInfo{};
     imageInfo.imageType = vk::ImageType::e2D;
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
     imageInfo.format = format;
     imageInfo.tiling = tiling;
@@ -865,70 +936,140 @@ tau::Image tau::Instance::createImage(uint32_t width, uint32_t height, vk::Forma
     Image img{};
     img.image = vk::raii::Image(device, imageInfo);
 
-    vk::MemoryRequirements memRequirements = img.image.getMemoryRequirements();
+    img.memory = allocator.allocate(img.image.getMemoryRequirements(), properties, MemoryPool::persistent, tiling == vk::ImageTiling::eLinear);
 
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties);
+    img.image.bindMemory(img.memory.memory, img.memory.offset);
 
-    img.memory = device.allocateMemory(allocInfo);
-
-    img.image.bindMemory(*img.memory, 0);
-
-    img.view = createImageView(*img.image, format, aspect);
+    img.view = createImageView(*img.image, format, aspect, mipLevels);
 
     return img;
 }
 
-#include <stb_image.h>
+tau::Image tau::Instance::loadColorTexture(const DecodedImage& decoded) {
+    auto x = decoded.width;
+    auto y = decoded.height;
 
-tau::Image tau::Instance::loadColorTexture(const char *path) {
-    int x;
-    int y;
-    int channels;
+    if (decoded.format != vk::Format::eR8G8B8A8Unorm) return loadCompressedTexture(decoded);
 
-    auto data =  stbi_load(path, &x, &y, &channels, STBI_rgb_alpha);
+    // full chain down to 1x1, so a big image in a small box doesn't alias
+    uint32_t levels = std::bit_width(std::max(x, y));
 
-    auto image = createImage(x, y, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+    vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+    if (levels > 1 && linearBlit) usage |= vk::ImageUsageFlagBits::eTransferSrc;
 
-    transitionImageLayout(*image.image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    auto image = createImage(x, y, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, usage, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor, levels);
 
-    vk::DeviceSize imageSize = x * y * STBI_rgb_alpha;
+    vk::DeviceSize imageSize = vk::DeviceSize(x) * y * 4;
 
-    auto[buffer, mem] = createBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    auto mapped = mem.mapMemory(0, imageSize);
-    std::memcpy(mapped, data, imageSize);
-    mem.unmapMemory();
+    // the device can't filter while blitting this format, the chain is built on the cpu instead
+    bool cpuMips = levels > 1 && !linearBlit;
+    vk::DeviceSize chainSize = 0;
 
-    stbi_image_free(data);
+    for (uint32_t i = 1, w = x, h = y; cpuMips && i < levels; ++i) {
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+        chainSize += vk::DeviceSize(w) * h * 4;
+    }
 
-    auto cmd = beginSingleCommand();
+    // level 0 is read while the chain is written, so it has to stay put until then: a range
+    // from the decoder is only committed afterwards, and otherwise one range holds both, so
+    // staging the chain can't wait for uploads and hand level 0's bytes out again
+    StagingRange range;
+    StagingRange chain;
 
-    vk::BufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = vk::Offset3D{0, 0, 0};
-    region.imageExtent = vk::Extent3D{static_cast<uint32_t>(x), static_cast<uint32_t>(y), 1};
+    if (decoded.staged) {
+        range = *decoded.staged;
 
-    cmd.copyBufferToImage(*buffer, *image.image, vk::ImageLayout::eTransferDstOptimal, { region });
-    
-    cmd.end();
-    
-    vk::CommandBuffer cb = *cmd;
-    
-    vk::SubmitInfo submitInfo{};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &cb;
-    
-    graphicsQueue.submit({ submitInfo });
-    graphicsQueue.waitIdle();
+        if (cpuMips) chain = stage(chainSize);
+    } else {
+        range = stage(imageSize + chainSize);
+        std::memcpy(range.mapped, decoded.pixels.get(), imageSize);
+
+        chain = range;
+        chain.offset += imageSize;
+        chain.mapped = static_cast<char*>(range.mapped) + imageSize;
+    }
+
+    if (cpuMips) {
+        auto src = static_cast<const unsigned char*>(range.mapped);
+        auto dst = static_cast<unsigned char*>(chain.mapped);
+
+        for (uint32_t i = 1, w = x, h = y; i < levels; ++i) {
+            downsample(src, w, h, dst);
+
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+
+            src = dst;
+            dst += vk::DeviceSize(w) * h * 4;
+        }
+    }
+
+    // nothing is staged past this point, so every copy below goes into the same batch
+    if (decoded.staged) staging.commit(range, uploads().serial);
+
+    auto& batch = uploads();
+    batch.transition(*image.image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, levels);
+    batch.copy(range, *image.image, x, y);
+
+    if (levels == 1) {
+        batch.handOff(*image.image);
+    } else if (linearBlit) {
+        batch.handOffWithMips(*image.image, x, y, levels);
+    } else {
+        vk::DeviceSize offset = 0;
+
+        for (uint32_t i = 1, w = x, h = y; i < levels; ++i) {
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+
+            auto level = chain;
+            level.offset += offset;
+
+            batch.copy(level, *image.image, w, h, i);
 
-    transitionImageLayout(*image.image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+            offset += vk::DeviceSize(w) * h * 4;
+        }
+
+        batch.handOff(*image.image, levels);
+    }
+
+    image.upload = batch.serial;
+
+    return image;
+}
+
+tau::Image tau::Instance::loadCompressedTexture(const DecodedImage& decoded) {
+    uint32_t levels = decoded.levels.size();
+
+    // block formats can't be blitted, the mips are whatever the file shipped
+    auto image = createImage(decoded.width, decoded.height, decoded.format, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor, levels);
+
+    auto& last = decoded.levels.back();
+    vk::DeviceSize size = last.offset + compressedSize(decoded.format, last.width, last.height);
+
+    StagingRange range;
+
+    if (decoded.staged) {
+        range = *decoded.staged;
+        staging.commit(range, uploads().serial);
+    } else {
+        range = stage(size);
+        std::memcpy(range.mapped, decoded.pixels.get(), size);
+    }
+
+    auto& batch = uploads();
+    batch.transition(*image.image, decoded.format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, levels);
+
+    for (uint32_t i = 0; i < levels; ++i) {
+        auto level = range;
+        level.offset += decoded.levels[i].offset;
+
+        batch.copy(level, *image.image, decoded.levels[i].width, decoded.levels[i].height, i);
+    }
+
+    batch.handOff(*image.image, levels);
+    image.upload = batch.serial;
 
     return image;
 }
@@ -955,11 +1096,41 @@ void tau::Instance::createFramebuffersForSwapchain(Swapchain& swapchain) {
 tau::Image tau::Instance::createDepthTexture() {
     vk::Format depthFormat = findDepthFormat(physicalDevice);
 
-    Image depth = createImage(swapchain.extent.width, swapchain.extent.height, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eDepth);
+    // no layout transition needed, the render pass takes the attachment from eUndefined every frame
+    return createImage(swapchain.extent.width, swapchain.extent.height, depthFormat, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eDepth);
+}
+
+tau::Image tau::Instance::createPlaceholder() {
+    auto image = createImage(1, 1, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+
+    // cleared on the graphics queue directly so it is usable from the very first frame, even
+    // while the first upload batch is still in flight on the transfer queue
+    UploadBatch batch;
+    batch.cmd = beginSingleCommand();
 
-    transitionImageLayout(*depth.image, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    vk::ClearColorValue transparent(std::array{ 0.0f, 0.0f, 0.0f, 0.0f });
 
-    return depth;
+    vk::ImageSubresourceRange range{};
+    range.aspectMask = vk::ImageAspectFlagBits::eColor;
+    range.levelCount = 1;
+    range.layerCount = 1;
+
+    batch.transition(*image.image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    batch.cmd.clearColorImage(*image.image, vk::ImageLayout::eTransferDstOptimal, transparent, { range });
+    batch.transition(*image.image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    batch.cmd.end();
+
+    vk::CommandBuffer cb = *batch.cmd;
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cb;
+
+    graphicsQueue.submit({ submitInfo });
+    graphicsQueue.waitIdle();
+
+    return image;
 }
 
 void tau::Swapchain::recreate(tau::Instance &instance) {
@@ -970,15 +1141,13 @@ void tau::Swapchain::recreate(tau::Instance &instance) {
         glfwWaitEvents();
     }
 
-    instance.device.waitIdle();
+    auto next = instance.createSwapchain(*swapchain);
 
-    // Destroy Swapchain before recreating
-    framebuffers.~vector();
-    imageViews.~vector();
-    images.~vector();
-    swapchain.~SwapchainKHR();
+    // frames still in flight render into the old images and framebuffers and test against the old
+    // depth texture, so they go once those frames have retired instead of draining the device
+    instance.defer([retired = std::move(*this), depth = std::move(instance.depthTexture)] {});
 
-    *this = instance.createSwapchain();
+    *this = std::move(next);
     instance.depthTexture = instance.createDepthTexture();
     instance.createFramebuffersForSwapchain(*this);
 }
@@ -7,14 +7,31 @@
 #include <glfw/glfw3.h>
 #include <vulkan/vulkan_raii.hpp>
 #include <string>
+#include <string_view>
 #include <fstream>
 
+#include "allocator.h"
+#include "atlas.h"
+#include "staging.h"
+#include "upload.h"
+#include "compressed.h"
+#include "decode.h"
+#include "thread_pool.h"
 #include "box.h"
 #include "dom.h"
+#include "layout_tree.h"
 
+#include <array>
 #include <vector>
+#include <compare>
+#include <deque>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <limits>
 #include <typeindex>
+#include <unordered_map>
 #include <memory>
 #include <sstream>
 
@@ -38,12 +55,53 @@ namespace tau {
     struct Image {
         vk::raii::Image image = nullptr;
         vk::raii::ImageView view = nullptr;
-        vk::raii::DeviceMemory memory = nullptr;
+        Allocation memory;
+        uint64_t upload = 0;
+
+        // upload serial of an image whose pixels aren't even decoded yet, never resident
+        static constexpr uint64_t pending = std::numeric_limits<uint64_t>::max();
+    };
+
+    struct AtlasPage {
+        Image image;
+        ShelfPacker packer;
+
+        // glyph pages only, how the text pipeline samples them; made when text is first drawn off it
+        vk::raii::DescriptorSet set = nullptr;
+    };
+
+    // everything a sampler is made of, identical keys share one vk::Sampler
+    struct SamplerKey {
+        vk::Filter filter = vk::Filter::eLinear;
+        vk::SamplerMipmapMode mipmap = vk::SamplerMipmapMode::eLinear;
+        vk::SamplerAddressMode address = vk::SamplerAddressMode::eClampToEdge;
+        float maxLod = VK_LOD_CLAMP_NONE;
+
+        auto operator<=>(const SamplerKey&) const = default;
     };
 
     struct CombinedImage {
         Image img;
-        vk::raii::Sampler sampler = nullptr;
+
+        // small images live on a shared page instead of in `img`, which then only tracks the upload
+        AtlasPage* page = nullptr;
+        vec2 uvOffset = { 0.0f, 0.0f };
+        vec2 uvScale = { 1.0f, 1.0f };
+
+        const vk::raii::ImageView& view() const { return page ? page->image.view : img.view; }
+
+        // elements holding an ImageRef to it; unreferenced entries are evicted least recently used
+        // first, by the serial of the last submitted frame that could have used them
+        uint32_t refs = 0;
+        uint64_t lastUsed = 0;
+        vk::DeviceSize bytes = 0;
+    };
+
+    struct ImageCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        vk::DeviceSize bytes = 0;
     };
     
     struct Pipeline {
@@ -53,7 +111,7 @@ namespace tau {
 
     struct UniformBuffer {
         vk::raii::Buffer buffer = nullptr;
-        vk::raii::DeviceMemory memory = nullptr;
+        Allocation memory;
         void* mapped = nullptr;
     };
 
@@ -65,23 +123,59 @@ namespace tau {
         std::vector<UniformBuffer> buffers;
     };
 
+    // a glyph's signed distance field on a glyph page, rasterized the first time it is asked for
     struct FontChar {
-        uint8_t* data;
-        uint8_t w;
-        uint8_t h;
-        int8_t x;
-        int8_t y;
-        float advance;
+        int index = 0;
+        float advance = 0.0f;
+
+        // everything below is only touched by the thread that records frames
+        bool ready = false;
+
+        // blanks like space have metrics but nothing on a page
+        AtlasPage* page = nullptr;
+        vec2 uvOffset = { 0.0f, 0.0f };
+        vec2 uvScale = { 0.0f, 0.0f };
+
+        uint8_t w = 0;
+        uint8_t h = 0;
+        int8_t x = 0;
+        int8_t y = 0;
+
+        // serial of the batch that copies it onto its page, it isn't drawn before that is acquired
+        uint64_t upload = Image::pending;
     };
 
+    // loading only reads the file, glyphs are made as text needs them
     struct Font {
         stbtt_fontinfo info;
         std::vector<char> buffer;
         float scale;
-        std::array<FontChar, 256> chars;
+
+        // from the baseline up to the top of the tallest glyph, in pixels at `scale`
+        float ascent = 0.0f;
+
+        // codepoint to glyph index to glyph, grown on first use; codepoints the font doesn't have
+        // all share its missing glyph. nothing is ever removed and map nodes don't move, so a
+        // reference stays good once the lock is gone
+        std::unordered_map<uint32_t, int> indices;
+        std::unordered_map<int, FontChar> glyphs;
+        std::shared_mutex mutex;
+
+        // the glyph and its advance, from any thread
+        FontChar& glyph(uint32_t codepoint);
 
         ~Font();
     };
+
+    // a glyph rasterized since the last flush, waiting to be copied onto its page
+    struct PendingGlyph {
+        FontChar* glyph;
+        AtlasPage* page;
+        AtlasSlot slot;
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint8_t> pixels;
+    };
     
     class Instance {
     public:
@@ -94,14 +188,26 @@ namespace tau {
         vk::raii::DebugUtilsMessengerEXT debugMessenger = nullptr;
         vk::raii::PhysicalDevice physicalDevice = nullptr;
         vk::raii::Device device = nullptr;
+        Allocator allocator;
+        StagingRing staging;
         vk::raii::Queue graphicsQueue = nullptr;
         vk::raii::Queue presentQueue = nullptr;
+        vk::raii::Queue transferQueue = nullptr;
+        uint32_t graphicsFamily = 0;
+        uint32_t transferFamily = 0;
+        bool linearBlit = false;
+        std::vector<vk::Format> compressedFormats;
         vk::raii::SurfaceKHR surface = nullptr;
         Swapchain swapchain;
         vk::raii::CommandPool commandPool = nullptr;
+        vk::raii::CommandPool transferPool = nullptr;
         vk::raii::CommandBuffers commandBuffers = nullptr;
+        std::optional<UploadBatch> openUpload;
+        std::deque<UploadBatch> pendingUploads;
+        std::vector<UploadBatch> spareUploads;
         vk::raii::RenderPass renderPass = nullptr;
         Image depthTexture;
+        Image placeholder;
         std::vector<vk::raii::Semaphore> imageAvailableSemaphores;
         std::vector<vk::raii::Semaphore> renderFinishedSemaphores;
         std::vector<vk::raii::Fence> inFlightFences;
@@ -109,6 +215,28 @@ namespace tau {
         std::map<std::type_index, PipelineCacheEntry> pipeline_cache;
         std::map<std::string, CombinedImage> image_cache;
         std::map<std::string, Font> font_cache;
+        std::map<SamplerKey, vk::raii::Sampler> sampler_cache;
+
+        // once textures owned by the cache go over this, unreferenced ones are evicted
+        vk::DeviceSize imageBudget = 256ull * 1024 * 1024;
+        ImageCacheStats imageStats;
+
+        // deque: entries keep pointers to their page
+        std::deque<AtlasPage> atlasPages;
+        static constexpr uint32_t atlas_page_size = 1024;
+        static constexpr uint32_t atlas_max_size = 128;
+
+        // draws text one quad per glyph, sampling the glyph page through the page's set; created on
+        // first use, and declared before the pages so their sets go back to the pool first
+        Pipeline textPipeline;
+        vk::raii::DescriptorSetLayout glyphSetLayout = nullptr;
+        vk::raii::DescriptorPool glyphPool = nullptr;
+
+        // single channel distance fields for every font, new glyphs go up once per frame
+        std::deque<AtlasPage> glyphPages;
+        std::vector<PendingGlyph> pendingGlyphs;
+        static constexpr uint32_t glyph_page_size = 1024;
+        static constexpr uint32_t glyph_max_pages = 16;
 
         template<typename Shader>
         PipelineCacheEntry* get_shader() {
@@ -192,7 +320,7 @@ namespace tau {
                 ub.buffer = std::move(buf);
                 ub.memory = std::move(mem);
 
-                ub.mapped = ub.memory.mapMemory(0, size);
+                ub.mapped = ub.memory.mapped;
 
                 entry.buffers.push_back(std::move(ub));
             }
@@ -219,20 +347,68 @@ namespace tau {
             return &pipeline_cache[typeid(Shader)];
         }
 
-        CombinedImage* getImage(std::string& img);
+        CombinedImage* getImage(std::string& img, ivec2 resolution = { 0, 0 });
+        vk::Sampler getSampler(const SamplerKey& key);
         Font* getFont(std::string& font);
-
-        std::unique_ptr<ComponentElement> top_component;
+        const FontChar& glyph(Font& font, uint32_t codepoint);
+        void flushGlyphs();
+
+        // `text` on one line with the top of its line box at x, y in pixels
+        void drawText(vk::raii::CommandBuffer& cmd, Font& font, std::string_view text, float x, float y);
+        void createTextPipeline();
+
+        std::mutex decodeMutex;
+        std::vector<DecodedImage> decoded;
+
+        // destructors that have to wait until no frame in flight can still be using what they free,
+        // keyed by the last frame submitted when they were deferred
+        std::deque<std::pair<uint64_t, std::move_only_function<void()>>> deferred;
+        uint64_t frameNumber = 0;
+
+        // serials of submitted frames, only counting ones that reached the queue; a frame slot's
+        // fence passing means its serial is done
+        uint64_t framesSubmitted = 0;
+        std::array<uint64_t, max_frames_in_flight> slotSubmitted{};
+
+        // the tree below top_component lives in treeArena, declared first so it goes last
+        std::unique_ptr<Arena> treeArena;
+        ptr<ComponentElement> top_component;
+        LayoutTree layoutTree;
         
         int currentFrame = 0;
         bool framebufferResized = false;
+
+        // acquire or present said the swapchain no longer fits; like a resize, it is only acted on
+        // at the start of the next frame
+        bool swapchainStale = false;
+
+        // rebuild was asked for, the tree is replaced at the start of the next frame
+        bool treeStale = false;
+
+        uint64_t uploadsSubmitted = 0;
+        uint64_t uploadsAcquired = 0;
+        uint64_t uploadsCompleted = 0;
         
         Instance();
         void loop();
 
-        void render(std::unique_ptr<ComponentElement>&& comp);
+        void render(ptr<ComponentElement>&& comp);
+
+        // the top component renders its tree again as a new generation: the old tree and its whole
+        // arena are dropped, between frames so nothing being recorded still points into them
+        void rebuild();
+        void build(ComponentElement& comp);
+        void relayout();
 
-        std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
+        std::pair<vk::raii::Buffer, Allocation> createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryPool pool = MemoryPool::persistent);
+
+        UploadBatch& uploads();
+        uint64_t flushUploads();
+        void retireUploads();
+        void waitUploads(uint64_t serial);
+        bool uploaded(uint64_t serial) const { return serial <= uploadsCompleted; }
+        bool resident(const Image& image) const { return image.upload <= uploadsAcquired; }
+        StagingRange stage(vk::DeviceSize size);
 
         void frame();
         void recordCommandBuffer(vk::raii::CommandBuffer& cmd, int frame, uint32_t image);
@@ -241,23 +417,37 @@ namespace tau {
         
         vk::raii::PhysicalDevice createPhysicalDevice();
         vk::raii::Device createDevice();
-        Swapchain createSwapchain();
+        // `old` is retired by the new swapchain, its images stay valid until it is destroyed
+        Swapchain createSwapchain(vk::SwapchainKHR old = nullptr);
         void createFramebuffersForSwapchain(Swapchain &swapchain);
         Image createDepthTexture();
+        Image createPlaceholder();
         
-        vk::raii::CommandPool createCommandPool();
+        vk::raii::CommandPool createCommandPool(uint32_t family);
         vk::raii::CommandBuffers createCommandBuffers();
         vk::raii::RenderPass createRenderPass();
         Pipeline createPipeline(const std::string& vert, const std::string& frag, std::span<vk::DescriptorSetLayout> sets = std::span<vk::DescriptorSetLayout>{});
         
-        Image createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlagBits properties, vk::ImageAspectFlagBits aspect);
-        Image loadColorTexture(const char* path);
-        vk::raii::ImageView createImageView(VkImage image, vk::Format format, vk::ImageAspectFlagBits aspectFlags);
+        Image createImage(uint32_t width, uint32_t height, vk::Format format, vk::ImageTiling tiling, vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, vk::ImageAspectFlagBits aspect, uint32_t mipLevels = 1);
+        Image loadColorTexture(const DecodedImage& image);
+        Image loadCompressedTexture(const DecodedImage& image);
+        bool packIntoAtlas(CombinedImage& entry, const DecodedImage& image);
+        void trimImages();
+        void defer(std::move_only_function<void()> fn);
+        void runDeferred();
+
+        // whether no frame submitted up to `serial` can still be running
+        bool retired(uint64_t serial) const;
+        void finishDecodes();
+        vk::raii::ImageView createImageView(VkImage image, vk::Format format, vk::ImageAspectFlagBits aspectFlags, uint32_t mipLevels = 1);
         vk::raii::CommandBuffer beginSingleCommand();
-        void transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+        vk::raii::CommandBuffer beginSingleCommand(const vk::raii::CommandPool& pool);
         // void draw(element<Gradient>& e, vk::raii::CommandBuffer& cmd);
         
         ~Instance();
+
+        // declared last: workers are joined before anything they hand results to is destroyed
+        ThreadPool workers;
     };
 }
 
@@ -0,0 +1,324 @@
+#include "layout_tree.h"
+#include "dom.h"
+
+void tau::LayoutTree::build(element& root) {
+    nodes.clear();
+    parent.clear();
+    firstChild.clear();
+    nextSibling.clear();
+
+    struct Pending {
+        element* el;
+        uint32_t parent;
+    };
+
+    std::vector<Pending> stack{ { &root, none } };
+    std::vector<uint32_t> lastChild;
+
+    while (!stack.empty()) {
+        auto[el, p] = stack.back();
+        stack.pop_back();
+
+        auto i = static_cast<uint32_t>(nodes.size());
+
+        nodes.push_back(el);
+        parent.push_back(p);
+        firstChild.push_back(none);
+        nextSibling.push_back(none);
+        lastChild.push_back(none);
+
+        if (p != none) {
+            if (lastChild[p] == none) firstChild[p] = i;
+            else nextSibling[lastChild[p]] = i;
+
+            lastChild[p] = i;
+        }
+
+        // everything gets laid out again after a rebuild
+        el->layoutDirty = true;
+        el->childrenChanged = false;
+
+        // foreign layouts place their own children
+        if (!std::holds_alternative<BlockLayout>(el->layout)) continue;
+
+        for (size_t c = el->children.size(); c-- > 0;) stack.push_back({ el->children[c].get(), i });
+    }
+
+    auto n = nodes.size();
+
+    subtreeEnd.assign(n, 0);
+
+    // reverse pre-order sees the last child before its parent
+    for (auto i = n; i-- > 0;) subtreeEnd[i] = lastChild[i] == none ? static_cast<uint32_t>(i + 1) : subtreeEnd[lastChild[i]];
+
+    flags.assign(n, 0);
+    marks.assign(n, 0);
+    width.assign(n, 0_px);
+    height.assign(n, 0_px);
+    paddingX.assign(n, 0_px);
+    paddingY.assign(n, 0_px);
+    marginX.assign(n, 0_px);
+    marginY.assign(n, 0_px);
+    marginPxX.assign(n, 0);
+    marginPxY.assign(n, 0);
+    insetX.assign(n, 0);
+    insetY.assign(n, 0);
+    available.assign(n, Box{});
+    bounds.assign(n, Box{});
+    content.assign(n, Box{});
+
+    touched.clear();
+    touched.reserve(n);
+}
+
+void tau::LayoutTree::load(uint32_t i) {
+    auto block = std::get_if<BlockLayout>(&nodes[i]->layout);
+
+    if (!block) {
+        flags[i] = foreign;
+        return;
+    }
+
+    Quantity zero = 0_px;
+
+    flags[i] = (block->dimensions.x ? fixedWidth : 0) | (block->dimensions.y ? fixedHeight : 0);
+
+    width[i] = block->dimensions.x.value_or(zero);
+    height[i] = block->dimensions.y.value_or(zero);
+    paddingX[i] = block->padding.x.value_or(zero);
+    paddingY[i] = block->padding.y.value_or(zero);
+    marginX[i] = block->margin.x.value_or(zero);
+    marginY[i] = block->margin.y.value_or(zero);
+}
+
+void tau::LayoutTree::layout(Box root) {
+    if (nodes.empty()) return;
+
+    // a changed child list anywhere means the arrays no longer match the tree
+    if (nodes[0]->childDirty || nodes[0]->layoutDirty) {
+        for (uint32_t i = 0; i < nodes.size();) {
+            auto el = nodes[i];
+
+            if (el->childrenChanged) {
+                build(*nodes[0]);
+                break;
+            }
+
+            i = (el->childDirty || el->layoutDirty) ? i + 1 : subtreeEnd[i];
+        }
+    }
+
+    auto n = static_cast<uint32_t>(nodes.size());
+
+    if (root.width != available[0].width || (heightMatters(0) && root.height != available[0].height)) marks[0] |= resized;
+    if (root.left != available[0].left || root.top != available[0].top) marks[0] |= moved;
+
+    available[0] = root;
+
+    touched.clear();
+
+    measure(0, touched);
+    place(0);
+}
+
+bool tau::LayoutTree::forks(uint32_t i, uint32_t root) const {
+    return pool && i != root && subtreeEnd[i] - i >= parallelThreshold;
+}
+
+void tau::LayoutTree::measure(uint32_t root, std::vector<uint32_t>& laidOut) {
+    auto end = subtreeEnd[root];
+
+    // big subtrees get their box before anything inside them is looked at and share nothing with
+    // their siblings, so they are measured on the pool while this carries on with the rest
+    std::optional<ThreadPool::Group> group;
+
+    // widths and provisional heights, parents first
+    for (uint32_t i = root; i < end;) {
+        auto el = nodes[i];
+
+        // the inside of a foreign layout isn't tracked here, any change in it means asking it again
+        bool inside = el->childDirty && (flags[i] & foreign);
+
+        if (!(el->layoutDirty || inside || (marks[i] & resized))) {
+            i = el->childDirty ? i + 1 : subtreeEnd[i];
+            continue;
+        }
+
+        if (forks(i, root)) {
+            if (!group) group.emplace(*pool);
+
+            group->fork([this, i] {
+                std::vector<uint32_t> own;
+                measure(i, own);
+            });
+
+            i = subtreeEnd[i];
+            continue;
+        }
+
+        marks[i] |= processed;
+        laidOut.push_back(i);
+
+        if (el->layoutDirty) load(i);
+
+        if (flags[i] & foreign) {
+            i = subtreeEnd[i];
+            continue;
+        }
+
+        auto& a = available[i];
+        auto& b = bounds[i];
+
+        b.width = (flags[i] & fixedWidth) ? width[i].pixels_relative_to(a.width) : a.width;
+        b.height = (flags[i] & fixedHeight) ? height[i].pixels_relative_to(a.width) : a.height;
+
+        marginPxX[i] = marginX[i].pixels_relative_to(a.width);
+        marginPxY[i] = marginY[i].pixels_relative_to(a.width);
+        insetX[i] = marginPxX[i] + paddingX[i].pixels_relative_to(b.width);
+        insetY[i] = marginPxY[i] + paddingY[i].pixels_relative_to(b.width);
+
+        for (auto c = firstChild[i]; c != none; c = nextSibling[c]) {
+            auto w = b.width - 2 * insetX[i];
+            auto h = b.height - 2 * insetY[i];
+
+            if (available[c].width != w || (heightMatters(c) && available[c].height != h)) marks[c] |= resized;
+
+            available[c].width = w;
+            available[c].height = h;
+        }
+
+        ++i;
+    }
+
+    // the heights below add up the forked subtrees'
+    if (group) group->wait();
+
+    // heights, children first: reverse pre-order visits every child before its parent, and the
+    // parent of a node whose height may have changed has always been laid out again too
+    for (auto it = laidOut.rbegin(); it != laidOut.rend(); ++it) {
+        auto i = *it;
+
+        if (flags[i] & foreign) {
+            // only the size matters here, it is laid out once in place below
+            auto size = measureElement(*nodes[i], available[i].width, available[i].height);
+
+            bounds[i].width = size.width;
+            bounds[i].height = size.height;
+            continue;
+        }
+
+        if (flags[i] & fixedHeight) continue;
+
+        uint32_t sum = 0;
+        for (auto c = firstChild[i]; c != none; c = nextSibling[c]) sum += bounds[c].height;
+
+        bounds[i].height = sum + 2 * insetY[i];
+    }
+}
+
+void tau::LayoutTree::place(uint32_t root) {
+    auto end = subtreeEnd[root];
+
+    std::optional<ThreadPool::Group> group;
+
+    // positions, parents first, only where something was laid out again or moved
+    for (uint32_t i = root; i < end;) {
+        auto el = nodes[i];
+        auto mark = marks[i];
+        bool place = mark & (processed | moved);
+        bool below = el->childDirty;
+
+        if ((place || below) && forks(i, root)) {
+            if (!group) group.emplace(*pool);
+
+            group->fork([this, i] { this->place(i); });
+
+            i = subtreeEnd[i];
+            continue;
+        }
+
+        el->layoutDirty = false;
+        el->childDirty = false;
+        marks[i] = 0;
+
+        if (!place) {
+            i = below ? i + 1 : subtreeEnd[i];
+            continue;
+        }
+
+        auto& a = available[i];
+
+        // nothing inside was laid out again, so the whole subtree just moves with its root
+        if (!(mark & processed) && !below) {
+            translate(i, a.left - bounds[i].left, a.top - bounds[i].top);
+
+            i = subtreeEnd[i];
+            continue;
+        }
+
+        if (flags[i] & foreign) {
+            bounds[i] = layoutElement(a, *el);
+            content[i] = el->content;
+            el->bounds = bounds[i];
+
+            i = subtreeEnd[i];
+            continue;
+        }
+
+        auto& b = bounds[i];
+        b.left = a.left;
+        b.top = a.top;
+
+        content[i] = {
+            .left = b.left + marginPxX[i],
+            .top = b.top + marginPxY[i],
+            .width = b.width - 2 * marginPxX[i],
+            .height = b.height - 2 * marginPxY[i]
+        };
+
+        el->bounds = b;
+        el->content = content[i];
+
+        auto top = b.top + insetY[i];
+
+        for (auto c = firstChild[i]; c != none; c = nextSibling[c]) {
+            auto left = b.left + insetX[i];
+
+            if (available[c].left != left || available[c].top != top) marks[c] |= moved;
+
+            available[c].left = left;
+            available[c].top = top;
+
+            top += bounds[c].height;
+        }
+
+        ++i;
+    }
+}
+
+bool tau::LayoutTree::heightMatters(uint32_t i) const {
+    // a node that is about to be loaded again is laid out regardless
+    return (flags[i] & foreign) || !(flags[i] & fixedHeight);
+}
+
+void tau::LayoutTree::translate(uint32_t i, uint32_t dx, uint32_t dy) {
+    // unsigned wrap-around makes adding dx the same as subtracting when it moved up or left
+    for (auto j = i; j < subtreeEnd[i]; ++j) {
+        if (j != i) {
+            available[j].left += dx;
+            available[j].top += dy;
+        }
+
+        bounds[j].left += dx;
+        bounds[j].top += dy;
+        content[j].left += dx;
+        content[j].top += dy;
+
+        // everything a foreign layout placed is relative to the box it was given
+        if (flags[j] & foreign) shiftChildren(*nodes[j], dx, dy);
+
+        nodes[j]->content = content[j];
+
+        nodes[j]->bounds = bounds[j];
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef LAYOUT_TREE_H
+#define LAYOUT_TREE_H
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "box.h"
+#include "quantities.h"
+#include "thread_pool.h"
+
+namespace tau {
+    struct element;
+
+    // the element tree flattened in pre-order, one entry per node in each array; layout runs as a
+    // few straight passes over them instead of recursing through virtual calls, and writes the
+    // results back into the elements at the end
+    //
+    // layout is incremental: a pass only descends into a subtree when its root is dirty, has a
+    // dirty descendant or got a different box from its parent, everything else keeps last
+    // layout's results; the box each node was given last time is the cache key, and a subtree that
+    // only got a new origin is translated rather than laid out
+    //
+    // nodes with a layout other than Block are foreign: they are sized through measureElement and
+    // laid out as leaves through layoutElement, and moved like any other subtree when clean
+    //
+    // with a pool, sibling subtrees of at least `parallelThreshold` nodes are measured and placed
+    // on it once their parent has given them their box, and joined before the parent goes on;
+    // smaller ones aren't worth the hand-off and stay on the calling thread
+    class LayoutTree {
+    public:
+        static constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t parallelThreshold = 4096;
+
+        void build(element& root);
+        void layout(Box available);
+
+        size_t size() const { return nodes.size(); }
+
+        // tightly packed, in the same order as the nodes, so it can be copied into a buffer as is;
+        // a foreign node has its own boxes here but the elements inside it aren't nodes, their
+        // boxes are only on the elements
+        std::span<const Box> contentBoxes() const { return content; }
+        std::span<const Box> boundsBoxes() const { return bounds; }
+
+        std::vector<element*> nodes;
+        std::vector<uint32_t> parent;
+        std::vector<uint32_t> firstChild;
+        std::vector<uint32_t> nextSibling;
+
+        // one past the last node of the subtree, so a clean subtree is skipped in one step
+        std::vector<uint32_t> subtreeEnd;
+
+        // sequential when null
+        ThreadPool* pool = nullptr;
+
+    private:
+        enum Flags : uint8_t {
+            fixedWidth = 1,
+            fixedHeight = 2,
+            foreign = 4
+        };
+
+        // per-node state of the current layout, only ever set on nodes a pass visits and cleared
+        // again by the last one
+        enum Marks : uint8_t {
+            resized = 1,
+            processed = 2,
+            moved = 4
+        };
+
+        void load(uint32_t i);
+
+        // the passes over the subtree of `root`, each of them may hand big child subtrees to the
+        // pool; `laidOut` collects whatever the measuring of this subtree laid out again
+        void measure(uint32_t root, std::vector<uint32_t>& laidOut);
+        void place(uint32_t root);
+
+        bool forks(uint32_t i, uint32_t root) const;
+
+        // a block only reads the height it is given when its own height is auto, otherwise its
+        // whole layout is a function of the width alone
+        bool heightMatters(uint32_t i) const;
+
+        // moves a subtree whose sizes are all still valid
+        void translate(uint32_t i, uint32_t dx, uint32_t dy);
+
+        std::vector<uint8_t> flags;
+        std::vector<uint8_t> marks;
+
+        // a missing padding or margin is 0px, a missing dimension is marked in `flags` instead
+        std::vector<Quantity> width;
+        std::vector<Quantity> height;
+        std::vector<Quantity> paddingX;
+        std::vector<Quantity> paddingY;
+        std::vector<Quantity> marginX;
+        std::vector<Quantity> marginY;
+
+        // margin and margin + padding in pixels, once the first pass has resolved them
+        std::vector<uint32_t> marginPxX;
+        std::vector<uint32_t> marginPxY;
+        std::vector<uint32_t> insetX;
+        std::vector<uint32_t> insetY;
+
+        std::vector<Box> available;
+        std::vector<Box> bounds;
+        std::vector<Box> content;
+
+        // nodes laid out again by the current layout outside of forked subtrees, in pre-order
+        std::vector<uint32_t> touched;
+    };
+}
+
+#endif
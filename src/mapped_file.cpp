@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+tau::MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    auto f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(f, &length) || length.QuadPart == 0) {
+        CloseHandle(f);
+        return;
+    }
+
+    auto m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        return;
+    }
+
+    auto view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return;
+    }
+
+    file = f;
+    mapping = m;
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(length.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return;
+    }
+
+    auto view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (view == MAP_FAILED) return;
+
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(st.st_size);
+#endif
+}
+
+tau::MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+tau::MappedFile& tau::MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this == &other) return *this;
+
+    close();
+
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+
+#ifdef _WIN32
+    file = std::exchange(other.file, nullptr);
+    mapping = std::exchange(other.mapping, nullptr);
+#endif
+
+    return *this;
+}
+
+tau::MappedFile::~MappedFile() {
+    close();
+}
+
+void tau::MappedFile::close() {
+    if (!data) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+
+    file = nullptr;
+    mapping = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+}
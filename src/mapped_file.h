@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+namespace tau {
+    // a whole file mapped read only, the pages are only read in once something touches them
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        ~MappedFile();
+
+        bool valid() const { return data != nullptr; }
+        std::span<const unsigned char> bytes() const { return { data, size }; }
+
+        void close();
+
+    private:
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+
+#ifdef _WIN32
+        void* file = nullptr;
+        void* mapping = nullptr;
+#endif
+    };
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "instance.h"
 
+#include <array>
+#include <cstdlib>
 #include <fstream>
 
 vk::raii::ShaderModule createShaderModule(const vk::raii::Device& device, const std::string& file) {
@@ -135,4 +137,38 @@ tau::Pipeline tau::Instance::createPipeline(const std::string& vert, const std::
     gpci.renderPass = *renderPass;
 
     return { .layout = std::move(layout), .pipeline = vk::raii::Pipeline(device, nullptr, gpci) };
-}
\ No newline at end of file
+}
+void tau::Instance::createTextPipeline() {
+    vk::DescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+    binding.descriptorCount = 1;
+    binding.stageFlags = vk::ShaderStageFlagBits::eFragment;
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    glyphSetLayout = device.createDescriptorSetLayout(layoutInfo);
+
+    // one set per glyph page, freed one by one when the pages go
+    vk::DescriptorPoolSize poolSize{};
+    poolSize.type = vk::DescriptorType::eCombinedImageSampler;
+    poolSize.descriptorCount = glyph_max_pages;
+
+    vk::DescriptorPoolCreateInfo dpci{};
+    dpci.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+    dpci.maxSets = glyph_max_pages;
+    dpci.poolSizeCount = 1;
+    dpci.pPoolSizes = &poolSize;
+
+    glyphPool = device.createDescriptorPool(dpci);
+
+    // compiled where it runs, the same as the generated view shaders
+    system("glslc shaders/text.vert -o text.vert.spv");
+    system("glslc shaders/text.frag -o text.frag.spv");
+
+    std::array<vk::DescriptorSetLayout, 1> sets = { *glyphSetLayout };
+
+    textPipeline = createPipeline("text.vert.spv", "text.frag.spv", sets);
+}
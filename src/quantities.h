@@ -6,13 +6,16 @@
 namespace tau {
     enum class quantity_t {
         percentage,
-        pixel
+        pixel,
+        fraction
     };
     
     struct Quantity { 
         quantity_t type;
         float value;
 
+        bool operator==(const Quantity&) const = default;
+
         template<typename T>
         T pixels_relative_to(T v) const {
             switch (type) {
@@ -22,6 +25,10 @@ namespace tau {
             case quantity_t::pixel:
                 return value;
                 break;
+            case quantity_t::fraction:
+                // a share of whatever a grid has left over, it means nothing on its own
+                return 0;
+                break;
             default:
                 std::unreachable();
                 break;
@@ -50,6 +57,14 @@ namespace tau {
         constexpr ::tau::Quantity operator ""_per (uint64_t v) {
             return { .type = quantity_t::percentage, .value = static_cast<float>(v) / 100.0f };
         }
+
+        constexpr ::tau::Quantity operator ""_fr (long double v) {
+            return { .type = quantity_t::fraction, .value = static_cast<float>(v) };
+        }
+
+        constexpr ::tau::Quantity operator ""_fr (uint64_t v) {
+            return { .type = quantity_t::fraction, .value = static_cast<float>(v) };
+        }
     }
 }
 
@@ -0,0 +1,88 @@
+#include "staging.h"
+#include "instance.h"
+
+static vk::DeviceSize alignUp(vk::DeviceSize v, vk::DeviceSize alignment) {
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+void tau::StagingRing::init(Instance& instance, vk::DeviceSize size) {
+    live.clear();
+
+    // drop the old buffer first so its memory can be reused for the new one
+    buffer = nullptr;
+    memory.reset();
+
+    auto[buf, mem] = instance.createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, MemoryPool::staging);
+
+    buffer = std::move(buf);
+    memory = std::move(mem);
+    capacity = size;
+}
+
+std::optional<tau::StagingRange> tau::StagingRing::reserve(vk::DeviceSize size, vk::DeviceSize alignment) {
+    if (size == 0) size = alignment;
+
+    std::lock_guard lock(mutex);
+
+    if (live.empty()) {
+        if (size > capacity) return std::nullopt;
+
+        return place(live.end(), 0, size);
+    }
+
+    // the free run between the end of `a` and the start of `b`, wrapping past the end of the buffer
+    // when b sits below a
+    auto fit = [&](const Span& a, const Span& b) -> std::optional<vk::DeviceSize> {
+        auto begin = alignUp(a.end, alignment);
+
+        if (b.begin >= a.end) {
+            if (begin + size <= b.begin) return begin;
+        } else {
+            if (begin + size <= capacity) return begin;
+            if (size <= b.begin) return 0;
+        }
+
+        return std::nullopt;
+    };
+
+    // past the head first, that keeps the ring in order as long as nothing is held up
+    if (auto begin = fit(live.back(), live.front())) return place(live.end(), *begin, size);
+
+    // a span still open at the tail (a decode in flight) pins it, so also reuse the holes left by
+    // ranges that retired behind it
+    for (size_t i = 0; i + 1 < live.size(); ++i) {
+        if (auto begin = fit(live[i], live[i + 1])) return place(live.begin() + i + 1, *begin, size);
+    }
+
+    return std::nullopt;
+}
+
+tau::StagingRange tau::StagingRing::place(std::deque<Span>::iterator at, vk::DeviceSize begin, vk::DeviceSize size) {
+    auto id = nextId++;
+    live.insert(at, { .begin = begin, .end = begin + size, .serial = open, .id = id });
+
+    return StagingRange{
+        .buffer = *buffer,
+        .offset = begin,
+        .size = size,
+        .mapped = static_cast<char*>(memory.mapped) + begin,
+        .id = id
+    };
+}
+
+void tau::StagingRing::commit(const StagingRange& range, uint64_t serial) {
+    std::lock_guard lock(mutex);
+
+    for (auto it = live.rbegin(); it != live.rend(); ++it) {
+        if (it->id == range.id) {
+            it->serial = serial;
+            return;
+        }
+    }
+}
+
+void tau::StagingRing::retire(uint64_t completed) {
+    std::lock_guard lock(mutex);
+
+    std::erase_if(live, [&](const Span& span) { return span.serial <= completed; });
+}
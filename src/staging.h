@@ -0,0 +1,64 @@
+#ifndef STAGING_H
+#define STAGING_H
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+
+#include "allocator.h"
+
+namespace tau {
+    class Instance;
+
+    struct StagingRange {
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+        vk::DeviceSize size = 0;
+        void* mapped = nullptr;
+        uint64_t id = 0;
+    };
+
+    // one persistently mapped host buffer that every upload copies out of; ranges are handed out in
+    // ring order and come back once the upload serial they were committed to has completed, each on
+    // its own so one range held open doesn't keep the ones after it from being reused
+    //
+    // decode workers reserve from it too, so everything but init is safe to call from any thread
+    class StagingRing {
+    public:
+        static constexpr vk::DeviceSize default_capacity = 32ull * 1024 * 1024;
+        static constexpr uint64_t open = std::numeric_limits<uint64_t>::max();
+
+        vk::DeviceSize capacity = 0;
+
+        void init(Instance& instance, vk::DeviceSize capacity);
+
+        std::optional<StagingRange> reserve(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+
+        // the range is recycled once `serial` completes, committing to 0 gives it back right away
+        void commit(const StagingRange& range, uint64_t serial);
+        void retire(uint64_t completed);
+
+    private:
+        struct Span {
+            vk::DeviceSize begin;
+            vk::DeviceSize end;
+            uint64_t serial;
+            uint64_t id;
+        };
+
+        StagingRange place(std::deque<Span>::iterator at, vk::DeviceSize begin, vk::DeviceSize size);
+
+        std::mutex mutex;
+        vk::raii::Buffer buffer = nullptr;
+        Allocation memory;
+
+        // in ring order from the oldest byte still in use, with holes where ranges retired early
+        std::deque<Span> live;
+        uint64_t nextId = 1;
+    };
+}
+
+#endif
@@ -1,6 +1,11 @@
+#include "decode.h"
+
+#define STBI_MALLOC(sz) tau::detail::stbi_malloc(sz)
+#define STBI_REALLOC(p, newsz) tau::detail::stbi_realloc(p, newsz)
+#define STBI_FREE(p) tau::detail::stbi_free(p)
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #define STB_TRUETYPE_IMPLEMENTATION
-#include <stb_truetype.h>
\ No newline at end of file
+#include <stb_truetype.h>
@@ -0,0 +1,146 @@
+#include "thread_pool.h"
+
+#include <limits>
+
+namespace {
+    // which pool and queue the current thread works for, if any
+    thread_local tau::ThreadPool* currentPool = nullptr;
+    thread_local size_t currentIndex = std::numeric_limits<size_t>::max();
+}
+
+size_t tau::ThreadPool::default_threads() {
+    // leave one core for the thread that records frames
+    auto n = std::thread::hardware_concurrency();
+
+    return n > 1 ? n - 1 : 1;
+}
+
+tau::ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i) workers.emplace_back([this, i] { run(i); });
+}
+
+tau::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+
+    cv.notify_all();
+}
+
+void tau::ThreadPool::submit(Job job) {
+    push({ .job = std::move(job) });
+}
+
+void tau::ThreadPool::push(Task task) {
+    // forks from a worker stay on its own queue, where it will most likely run them itself
+    auto& queue = currentPool == this ? *queues[currentIndex] : shared;
+
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    queued.fetch_add(1);
+
+    // taking the lock makes sure a worker that just saw nothing queued is already waiting
+    { std::lock_guard lock(mutex); }
+    cv.notify_one();
+}
+
+bool tau::ThreadPool::pop(size_t self, Task& task) {
+    auto take = [&](Queue& queue, bool newest) {
+        std::lock_guard lock(queue.mutex);
+
+        if (queue.tasks.empty()) return false;
+
+        if (newest) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+
+        queued.fetch_sub(1);
+        return true;
+    };
+
+    if (self < queues.size() && take(*queues[self], true)) return true;
+    if (take(shared, false)) return true;
+
+    for (size_t i = 1; i <= queues.size(); ++i) {
+        auto victim = (self + i) % queues.size();
+
+        if (victim != self && take(*queues[victim], false)) return true;
+    }
+
+    return false;
+}
+
+bool tau::ThreadPool::popGroup(const Group* group, Task& task) {
+    auto take = [&](Queue& queue) {
+        std::lock_guard lock(queue.mutex);
+
+        // newest first, that's the one most likely to still be hot
+        for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+            if (it->group != group) continue;
+
+            task = std::move(*it);
+            queue.tasks.erase(std::next(it).base());
+
+            queued.fetch_sub(1);
+            return true;
+        }
+
+        return false;
+    };
+
+    if (currentPool == this && take(*queues[currentIndex])) return true;
+    if (take(shared)) return true;
+
+    for (auto& queue : queues) {
+        if (take(*queue)) return true;
+    }
+
+    return false;
+}
+
+void tau::ThreadPool::execute(Task& task) {
+    task.job();
+
+    if (task.group) task.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void tau::ThreadPool::run(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+
+            if (stopping) return;
+        }
+
+        Task task;
+
+        if (pop(index, task)) execute(task);
+    }
+}
+
+void tau::ThreadPool::Group::fork(Job job) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    pool.push({ .job = std::move(job), .group = this });
+}
+
+void tau::ThreadPool::Group::wait() {
+    while (pending.load(std::memory_order_acquire) > 0) {
+        Task task;
+
+        if (pool.popGroup(this, task)) pool.execute(task);
+        else std::this_thread::yield();
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tau {
+    // every worker has its own queue: it runs the newest job of its own and steals the oldest of
+    // the others' when it runs dry, jobs submitted from outside the pool go through a shared one
+    class ThreadPool {
+    public:
+        using Job = std::move_only_function<void()>;
+
+        // jobs forked together and waited on together; the waiting thread runs the group's own
+        // jobs in the meantime instead of blocking, so groups can nest without tying up workers,
+        // and never picks up unrelated work like a decode
+        class Group {
+        public:
+            explicit Group(ThreadPool& pool) : pool(pool) {}
+            ~Group() { wait(); }
+
+            Group(const Group&) = delete;
+            Group& operator=(const Group&) = delete;
+
+            void fork(Job job);
+            void wait();
+
+        private:
+            friend class ThreadPool;
+
+            ThreadPool& pool;
+            std::atomic<size_t> pending = 0;
+        };
+
+        explicit ThreadPool(size_t threads = default_threads());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(Job job);
+
+        size_t size() const { return workers.size(); }
+
+        static size_t default_threads();
+
+    private:
+        struct Task {
+            Job job;
+            Group* group = nullptr;
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        Queue shared;
+
+        // workers sleep on this while nothing is queued anywhere
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<size_t> queued = 0;
+        bool stopping = false;
+
+        // last so the threads are joined before the queues they read from go away, whatever is
+        // still queued by then is dropped
+        std::vector<std::jthread> workers;
+
+        void push(Task task);
+        bool pop(size_t self, Task& task);
+        bool popGroup(const Group* group, Task& task);
+        void execute(Task& task);
+        void run(size_t index);
+    };
+}
+
+#endif
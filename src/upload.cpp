@@ -0,0 +1,429 @@
+#include "upload.h"
+#include "instance.h"
+
+#include <algorithm>
+#include <limits>
+
+static bool hasStencilComponent(vk::Format format) {
+    return format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eD24UnormS8Uint;
+}
+
+void tau::UploadBatch::transition(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t levels) {
+    vk::ImageMemoryBarrier barrier{};
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vk::PipelineStageFlagBits sourceStage;
+    vk::PipelineStageFlagBits destinationStage;
+
+    if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
+        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+
+        if (hasStencilComponent(format)) {
+            barrier.subresourceRange.aspectMask |= vk::ImageAspectFlagBits::eStencil;
+        }
+    } else {
+        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    }
+
+    if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal) {
+        barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+
+        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
+        destinationStage = vk::PipelineStageFlagBits::eTransfer;
+    } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+        sourceStage = vk::PipelineStageFlagBits::eTransfer;
+        destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
+    } else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
+        barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+        barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+        sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
+        destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
+    } else {
+        throw std::invalid_argument("unsupported layout transition!");
+    }
+
+    cmd.pipelineBarrier(sourceStage, destinationStage, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+}
+
+void tau::UploadBatch::copy(const StagingRange& range, vk::Image image, uint32_t width, uint32_t height, uint32_t level) {
+    vk::BufferImageCopy region{};
+    region.bufferOffset = range.offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = vk::Offset3D{0, 0, 0};
+    region.imageExtent = vk::Extent3D{width, height, 1};
+
+    cmd.copyBufferToImage(range.buffer, image, vk::ImageLayout::eTransferDstOptimal, { region });
+}
+
+void tau::UploadBatch::handOff(vk::Image image, uint32_t levels) {
+    if (!split()) {
+        transition(image, vk::Format::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, levels);
+        return;
+    }
+
+    vk::ImageMemoryBarrier barrier{};
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+    barrier.srcQueueFamilyIndex = transferFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // release: the destination access is meaningless on the transfer queue
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eNone;
+
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+
+    // acquire: has to repeat the exact same layout transition, the semaphore covers availability
+    barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    acquire.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eFragmentShader, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+}
+
+void tau::UploadBatch::handOffWithMips(vk::Image image, uint32_t width, uint32_t height, uint32_t levels) {
+    vk::ImageMemoryBarrier barrier{};
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    if (split()) {
+        // move the whole image over as is, still in eTransferDstOptimal
+        barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eNone;
+
+        cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+
+        barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+
+        acquire.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+
+    auto& gfx = graphics();
+
+    barrier.subresourceRange.levelCount = 1;
+
+    int32_t w = width;
+    int32_t h = height;
+
+    for (uint32_t i = 1; i < levels; ++i) {
+        // level i - 1 is complete, read from it for level i
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+
+        gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+
+        vk::ImageBlit blit{};
+        blit.srcOffsets[1] = vk::Offset3D{ w, h, 1 };
+        blit.srcSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
+
+        blit.dstOffsets[1] = vk::Offset3D{ w, h, 1 };
+        blit.dstSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        blit.dstSubresource.mipLevel = i;
+        blit.dstSubresource.baseArrayLayer = 0;
+        blit.dstSubresource.layerCount = 1;
+
+        gfx.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal, { blit }, vk::Filter::eLinear);
+
+        barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+        barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+        gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+    }
+
+    // the last level was only ever written to
+    barrier.subresourceRange.baseMipLevel = levels - 1;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+}
+
+void tau::UploadBatch::clearPage(vk::Image image) {
+    vk::ImageSubresourceRange range{};
+    range.aspectMask = vk::ImageAspectFlagBits::eColor;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    vk::ImageMemoryBarrier barrier{};
+    barrier.oldLayout = vk::ImageLayout::eUndefined;
+    barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    barrier.srcAccessMask = vk::AccessFlagBits::eNone;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+
+    auto& gfx = graphics();
+
+    gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+    gfx.clearColorImage(image, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue(0.0f, 0.0f, 0.0f, 0.0f), { range });
+
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+}
+
+void tau::UploadBatch::patch(const StagingRange& range, vk::Image image, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    vk::BufferImageCopy region{};
+    region.bufferOffset = range.offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = vk::Offset3D{ int32_t(x), int32_t(y), 0 };
+    region.imageExtent = vk::Extent3D{ width, height, 1 };
+
+    patch(range.buffer, image, { &region, 1 });
+}
+
+void tau::UploadBatch::patch(vk::Buffer buffer, vk::Image image, std::span<const vk::BufferImageCopy> regions) {
+    vk::ImageMemoryBarrier barrier{};
+    barrier.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    // earlier frames may still be sampling the rest of the page
+    barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+
+    auto& gfx = graphics();
+
+    gfx.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+
+    gfx.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, vk::ArrayProxy<const vk::BufferImageCopy>(static_cast<uint32_t>(regions.size()), regions.data()));
+
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+    gfx.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, (vk::DependencyFlagBits)0, nullptr, nullptr, { barrier });
+}
+
+tau::UploadBatch& tau::Instance::uploads() {
+    if (openUpload) return *openUpload;
+
+    UploadBatch batch;
+
+    if (!spareUploads.empty()) {
+        batch = std::move(spareUploads.back());
+        spareUploads.pop_back();
+
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+        batch.cmd.reset();
+        batch.cmd.begin(beginInfo);
+
+        if (batch.split()) {
+            batch.acquire.reset();
+            batch.acquire.begin(beginInfo);
+        }
+    } else {
+        batch.transferFamily = transferFamily;
+        batch.graphicsFamily = graphicsFamily;
+        batch.cmd = beginSingleCommand(transferPool);
+        batch.fence = device.createFence(vk::FenceCreateInfo{});
+
+        if (batch.split()) {
+            batch.acquire = beginSingleCommand(commandPool);
+            batch.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
+        }
+    }
+
+    batch.serial = uploadsSubmitted + 1;
+    batch.state = UploadBatch::State::recording;
+
+    openUpload = std::move(batch);
+
+    return *openUpload;
+}
+
+uint64_t tau::Instance::flushUploads() {
+    if (!openUpload) return uploadsSubmitted;
+
+    auto batch = std::move(*openUpload);
+    openUpload.reset();
+
+    batch.cmd.end();
+
+    vk::CommandBuffer cb = *batch.cmd;
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cb;
+
+    if (batch.split()) {
+        batch.acquire.end();
+
+        vk::Semaphore signal = *batch.semaphore;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signal;
+
+        transferQueue.submit({ submitInfo }, *batch.fence);
+        batch.state = UploadBatch::State::transferring;
+    } else {
+        graphicsQueue.submit({ submitInfo }, *batch.fence);
+        batch.state = UploadBatch::State::acquiring;
+        uploadsAcquired = batch.serial;
+    }
+
+    uploadsSubmitted = batch.serial;
+    pendingUploads.push_back(std::move(batch));
+
+    return uploadsSubmitted;
+}
+
+void tau::Instance::retireUploads() {
+    while (!pendingUploads.empty()) {
+        auto& batch = pendingUploads.front();
+
+        if (batch.state != UploadBatch::State::acquiring || batch.fence.getStatus() != vk::Result::eSuccess) break;
+
+        device.resetFences({ *batch.fence });
+        batch.scratch.clear();
+
+        uploadsCompleted = batch.serial;
+        spareUploads.push_back(std::move(batch));
+        pendingUploads.pop_front();
+    }
+
+    // hand finished copies over to the graphics queue, in order; the semaphore is already signaled
+    // by the time we wait on it, so none of this can stall the frame that follows
+    for (auto& batch : pendingUploads) {
+        if (batch.state != UploadBatch::State::transferring) continue;
+        if (batch.fence.getStatus() != vk::Result::eSuccess) break;
+
+        device.resetFences({ *batch.fence });
+
+        vk::CommandBuffer cb = *batch.acquire;
+        vk::Semaphore wait = *batch.semaphore;
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+
+        vk::SubmitInfo submitInfo{};
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &wait;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &cb;
+
+        graphicsQueue.submit({ submitInfo }, *batch.fence);
+
+        batch.state = UploadBatch::State::acquiring;
+        uploadsAcquired = batch.serial;
+    }
+
+    staging.retire(uploadsCompleted);
+}
+
+void tau::Instance::waitUploads(uint64_t serial) {
+    if (openUpload && openUpload->serial <= serial) flushUploads();
+
+    retireUploads();
+
+    // a split batch needs two rounds, one for the copies and one for the acquire
+    while (uploadsCompleted < serial && !pendingUploads.empty()) {
+        device.waitForFences({ *pendingUploads.front().fence }, true, std::numeric_limits<uint64_t>::max());
+
+        retireUploads();
+    }
+}
+
+tau::StagingRange tau::Instance::stage(vk::DeviceSize size) {
+    auto range = staging.reserve(size);
+
+    if (!range && size <= staging.capacity) {
+        // whatever is still in the ring belongs to recorded uploads, let them finish and try again
+        waitUploads(uploads().serial);
+
+        range = staging.reserve(size);
+    }
+
+    auto& batch = uploads();
+
+    if (!range) {
+        // bigger than the whole ring, or the rest is held by decodes still in progress
+        auto[buffer, memory] = createBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, MemoryPool::staging);
+
+        StagingRange scratch{ .buffer = *buffer, .offset = 0, .size = size, .mapped = memory.mapped };
+
+        batch.scratch.emplace_back(std::move(buffer), std::move(memory));
+
+        return scratch;
+    }
+
+    staging.commit(*range, batch.serial);
+
+    return *range;
+}
@@ -0,0 +1,63 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "allocator.h"
+#include "staging.h"
+
+#include <span>
+#include <vector>
+
+namespace tau {
+    // barriers and copies for any number of resources recorded into one command buffer, submitted
+    // once and tracked by a single fence; its staging ranges come back once `serial` completes
+    //
+    // with a dedicated transfer family `cmd` runs on the transfer queue and ends by releasing every
+    // image to the graphics family, `acquire` picks them up on the graphics queue - it is only
+    // submitted once the copies are done, so a big upload never holds up a frame
+    struct UploadBatch {
+        enum class State {
+            recording,
+            transferring,
+            acquiring
+        };
+
+        uint64_t serial = 0;
+        State state = State::recording;
+        uint32_t transferFamily = 0;
+        uint32_t graphicsFamily = 0;
+        vk::raii::CommandBuffer cmd = nullptr;
+        vk::raii::CommandBuffer acquire = nullptr;
+        vk::raii::Semaphore semaphore = nullptr;
+        vk::raii::Fence fence = nullptr;
+
+        // one-off staging buffers for whatever didn't fit in the ring, freed with the batch
+        std::vector<std::pair<vk::raii::Buffer, Allocation>> scratch;
+
+        bool split() const { return transferFamily != graphicsFamily; }
+
+        // whichever of the two runs on the graphics queue
+        vk::raii::CommandBuffer& graphics() { return split() ? acquire : cmd; }
+
+        void transition(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t levels = 1);
+        void copy(const StagingRange& range, vk::Image image, uint32_t width, uint32_t height, uint32_t level = 0);
+
+        // eTransferDstOptimal -> eShaderReadOnlyOptimal, owned by the graphics family afterwards
+        void handOff(vk::Image image, uint32_t levels = 1);
+
+        // same as handOff, but fills levels 1..n from level 0 with linear blits first; blits need a
+        // graphics queue, so on a split batch they are recorded into `acquire`
+        void handOffWithMips(vk::Image image, uint32_t width, uint32_t height, uint32_t levels);
+
+        // shared atlas pages stay with the graphics family and in eShaderReadOnlyOptimal, these
+        // record on the graphics side so a page is never bounced between queues
+        void clearPage(vk::Image image);
+        void patch(const StagingRange& range, vk::Image image, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+        // any number of rectangles of one page in a single copy, all out of `buffer`
+        void patch(vk::Buffer buffer, vk::Image image, std::span<const vk::BufferImageCopy> regions);
+    };
+}
+
+#endif
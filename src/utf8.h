@@ -0,0 +1,56 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace tau {
+    constexpr uint32_t replacement_character = 0xfffd;
+
+    // the codepoint starting at `i`, with `i` moved past it; anything malformed comes out as
+    // U+FFFD - overlong sequences and surrogates as one, stray or truncated bytes one each, so
+    // decoding picks up again right after them
+    inline uint32_t nextCodepoint(std::string_view s, size_t& i) {
+        auto lead = static_cast<uint8_t>(s[i++]);
+
+        if (lead < 0x80) return lead;
+
+        size_t extra;
+        uint32_t cp;
+        uint32_t min;
+
+        if ((lead & 0xe0) == 0xc0) {
+            extra = 1;
+            cp = lead & 0x1f;
+            min = 0x80;
+        } else if ((lead & 0xf0) == 0xe0) {
+            extra = 2;
+            cp = lead & 0x0f;
+            min = 0x800;
+        } else if ((lead & 0xf8) == 0xf0) {
+            extra = 3;
+            cp = lead & 0x07;
+            min = 0x10000;
+        } else {
+            return replacement_character;
+        }
+
+        if (i + extra > s.size()) return replacement_character;
+
+        for (size_t k = 0; k < extra; ++k) {
+            auto c = static_cast<uint8_t>(s[i + k]);
+
+            if ((c & 0xc0) != 0x80) return replacement_character;
+
+            cp = (cp << 6) | (c & 0x3f);
+        }
+
+        i += extra;
+
+        if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) return replacement_character;
+
+        return cp;
+    }
+}
+
+#endif